@@ -0,0 +1,102 @@
+/********************************************************************
+ * Adaptive run length
+ * See adapt.h for PHI_PRECISION, PHI_MIN_TIME and PHI_BUDGET.
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "timer.h"
+#include "adapt.h"
+
+static double precision;						//target in percent, 0 without PHI_PRECISION
+static double min_time=ADAPT_MIN_TIME/1000;		//seconds
+static double budget=ADAPT_BUDGET;				//seconds
+
+/* the 97.5% quantile of Student's t distribution for df degrees of freedom */
+static double student_t(int df)
+{
+	static const double t[30]={12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+	return df<=30 ? t[df-1] : 1.960;
+}
+
+void adapt_init(void)
+{
+	const char *env;
+
+	if ((env=getenv("PHI_PRECISION"))!=NULL && (precision=atof(env))<=0)
+	{
+		fprintf(stderr, "PHI_PRECISION: expected a percentage above 0, using the fixed run lengths\n");
+		precision=0;
+	}
+	if ((env=getenv("PHI_MIN_TIME"))!=NULL && atof(env)>0)
+		min_time=atof(env)/1000;
+	if ((env=getenv("PHI_BUDGET"))!=NULL && atof(env)>0)
+		budget=atof(env);
+}
+
+int adapt_enabled(void)
+{
+	return precision>0;
+}
+
+long adapt_scale(long count, double time)
+{
+	double factor;
+
+	if (time>=min_time)
+		return count;
+	//aim a fifth above the minimum, at most a thousand times more per step
+	factor = time>0 ? 1.2*min_time/time : 1000;
+	if (factor>1000)
+		factor=1000;
+	return count*factor>count+1 ? (long) (count*factor) : count+1;
+}
+
+void adapt_begin(adapt_t *a)
+{
+	memset(a, 0, sizeof(*a));
+	a->start=bi_gettime();
+}
+
+double adapt_precision(const adapt_t *a)
+{
+	double mean, var;
+
+	if (a->n<2)
+		return 100;
+	mean=a->sum/a->n;
+	var=(a->sumsq-a->n*mean*mean)/(a->n-1);
+	if (mean<=0)
+		return 100;
+	return 100*student_t(a->n-1)*sqrt(var>0 ? var : 0)/sqrt(a->n)/mean;
+}
+
+int adapt_more(adapt_t *a, double time)
+{
+	a->n++;
+	a->sum+=time;
+	a->sumsq+=time*time;
+	if (a->n<ADAPT_MIN_RUNS)
+		return 1;
+	if (a->n>=ADAPT_MAX_RUNS || bi_gettime()-a->start>=budget)
+		return 0;
+	return adapt_precision(a)>precision;
+}
+
+void adapt_print(const adapt_t *a)
+{
+	if (adapt_enabled())
+		printf("\tRuns:\t%d\tPrecision (%%):\t%.2f", a->n, adapt_precision(a));
+}
+
+void adapt_params(char *buf, size_t size, const adapt_t *a)
+{
+	size_t len=strlen(buf);
+
+	if (adapt_enabled() && len<size)
+		snprintf(buf+len, size-len, "%sruns=%d;ci=%.3f", len ? ";" : "", a->n, adapt_precision(a));
+}
@@ -0,0 +1,67 @@
+/********************************************************************
+ * Adaptive run length for the timed repetitions
+ *
+ * With the environment variable PHI_PRECISION=<percent>, the benchmarks
+ * stop repeating a measurement when the half-width of the 95% confidence
+ * interval of the mean is below that percentage of the mean, instead of
+ * running a fixed number of repetitions:
+ *   1. the work of one repetition (passes, jumps, kernel calls) is scaled
+ *      up until a repetition lasts at least PHI_MIN_TIME milliseconds
+ *      (default ADAPT_MIN_TIME), above the useful resolution of the timer
+ *   2. repetitions are added until the interval is narrow enough, at least
+ *      ADAPT_MIN_RUNS and at most ADAPT_MAX_RUNS of them, or until
+ *      PHI_BUDGET seconds (default ADAPT_BUDGET) have been spent on them
+ * The runs and the achieved precision are printed after every result and
+ * added to the params of its record. Without PHI_PRECISION the fixed
+ * counts of the benchmarks are used.
+ *******************************************************************/
+
+#ifndef PHI_ADAPT_H
+#define PHI_ADAPT_H
+
+#include <stddef.h>
+
+#define ADAPT_MIN_TIME 10.0						//default milliseconds of a repetition
+#define ADAPT_BUDGET 10.0						//default seconds of the repetitions of one result
+#define ADAPT_MIN_RUNS 3
+#define ADAPT_MAX_RUNS 1000
+
+/*!@brief The repetitions of one result */
+typedef struct
+{
+	int n;								/**< repetitions so far */
+	double sum, sumsq;					/**< of the times per unit of work */
+	double start;						/**< bi_gettime() of adapt_begin() */
+}adapt_t;
+
+/*!@brief Reads PHI_PRECISION, PHI_MIN_TIME and PHI_BUDGET. Has to be called once in main(). */
+void adapt_init(void);
+
+/*!@brief Nonzero if PHI_PRECISION is set. */
+int adapt_enabled(void);
+
+/*!@brief The work of the next repetition, if one of count units took time
+ *        seconds: count if that was long enough, more otherwise.
+ */
+long adapt_scale(long count, double time);
+
+/*!@brief Starts counting the repetitions of a result. */
+void adapt_begin(adapt_t *a);
+
+/*!@brief Adds a repetition that took time seconds per unit of work.
+ * @return Nonzero if another repetition is needed.
+ */
+int adapt_more(adapt_t *a, double time);
+
+/*!@brief Half-width of the 95% confidence interval of the mean in percent of the mean. */
+double adapt_precision(const adapt_t *a);
+
+/*!@brief Prints "\tRuns:\t<n>\tPrecision (%):\t<p>", nothing without PHI_PRECISION. */
+void adapt_print(const adapt_t *a);
+
+/*!@brief Appends ";runs=<n>;ci=<p>" to buf, with the precision p in percent,
+ *        nothing without PHI_PRECISION.
+ */
+void adapt_params(char *buf, size_t size, const adapt_t *a);
+
+#endif
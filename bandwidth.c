@@ -57,20 +57,39 @@
 #include <sys/stat.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <sched.h>
 #include <time.h>
 
 #include <immintrin.h>
 
-#ifdef MCDRAM
-#include <hbwmalloc.h>
-#endif
+#include "timer.h"
+#include "placement.h"
+#include "memory.h"
+#include "rng.h"
+#include "bench.h"
+#include "result.h"
+#include "counters.h"
+#include "barrier.h"
+#include "cache.h"
+#include "adapt.h"
+#include "power.h"
 
 #ifndef STREAM_ARRAY_SIZE
 #   define STREAM_ARRAY_SIZE	128000000
 #endif
 
+/*  The array size is a runtime parameter (MB per array); STREAM_ARRAY_SIZE
+ *         is only the default. The sweep mode measures from SWEEP_MIN_SIZE
+ *         up to the largest size in one allocation, repeating every kernel
+ *         inside the timed region until at least SWEEP_MIN_BYTES per array
+ *         have been moved, so cache-resident sizes are timed reliably.
+ */
+#define SWEEP_MIN_SIZE (4L*1024)						//smallest bytes per array of the sweep mode
+#define SWEEP_STEPS_PER_OCTAVE 2						//sizes per doubling of the sweep mode
+#define SWEEP_MIN_BYTES (64L*1024*1024)					//bytes per array and timed run in the sweep mode
+
 /*  2) STREAM runs each kernel "NTIMES" times and reports the *best* result
  *         for any iteration after the first, therefore the minimum value
  *         for NTIMES is 2.
@@ -157,21 +176,41 @@ STREAM_TYPE	*a;//[STREAM_ARRAY_SIZE+OFFSET] __attribute__((aligned(64)));
 STREAM_TYPE	*b;//[STREAM_ARRAY_SIZE+OFFSET] __attribute__((aligned(64)));
 STREAM_TYPE	*c;//[STREAM_ARRAY_SIZE+OFFSET] __attribute__((aligned(64)));
 
-static double	avgtime[4] = {0}, maxtime[4] = {0},
-		mintime[4] = {FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX};
+size_t	array_size = STREAM_ARRAY_SIZE;		//elements per array
+uint32_t	*idx;						//indices of gather and scatter, only allocated if they run
 
-static char	*label[4] = {"Copy:      ", "Scale:     ",
-	"Add:       ", "Triad:     "};
+#define MAX_KERNELS 9
+static double	avgtime[MAX_KERNELS] = {0}, maxtime[MAX_KERNELS] = {0},
+		mintime[MAX_KERNELS];
+static double	counts[MAX_KERNELS][CNT_MAX_EVENTS];	//PHI_COUNTERS of all threads over the runs after the first
+static pwr_t	power[MAX_KERNELS];					//frequency and power over the runs after the first
 
-static double	bytes[4] = {
-	2 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-	2 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-	3 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-	3 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE
-};
+/* index patterns of gather and scatter, PHI_INDEX */
+enum {INDEX_SEQ, INDEX_STRIDE, INDEX_RANDOM};
+static int	index_pattern = INDEX_RANDOM;
+static long	index_stride = 16;
+
+/*
+ *	Software prefetch distances of PHI_PREFETCH, in cache lines ahead of the
+ *	loads. The kernels with a prefetch variant issue one L2 (_MM_HINT_T1) and
+ *	one L1 (_MM_HINT_T0) prefetch per line they read, 0 leaves out a level.
+ *	Prefetches do not fault, so they may run past the end of a slice.
+ */
+#define PREFETCH_MAX 16							//distances per level of a grid
+#define LINE_WORDS (64/sizeof(STREAM_TYPE))
+static long	prefetch_l1, prefetch_l2;				//of the kernels that run next
+static long	prefetch_l1s[PREFETCH_MAX], prefetch_l2s[PREFETCH_MAX];
+static int	nprefetch_l1 = 1, nprefetch_l2 = 1;
+static const long prefetch_sweep_l1[] = {0, 1, 2, 4, 8, 16, 32};
+static const long prefetch_sweep_l2[] = {0, 8, 16, 32, 64, 128, 256};
+static char	prefetch_spec[256] = "off";
+
+#define PREFETCH(p, d1, d2) do { \
+	if (d2) _mm_prefetch((const char *) ((p)+(d2)), _MM_HINT_T1); \
+	if (d1) _mm_prefetch((const char *) ((p)+(d1)), _MM_HINT_T0); \
+	} while (0)
 
-extern double mysecond();
-extern void checkSTREAMresults();
+extern int checkSTREAMresults();
 #ifdef TUNED
 extern void tuned_STREAM_Copy();
 extern void tuned_STREAM_Scale(STREAM_TYPE scalar);
@@ -183,46 +222,1046 @@ extern int omp_get_num_threads();
 #endif
 int get_cpu_id (int tid)
 {
-//#ifdef SCATTER
-//        int gid=tid%60;
-//        int iid=(int)(floor(1.0*tid/60));
-        //printf ("%d\n", (1+gid*4+iid)%240);
-//        return (1+gid*4+iid)%240;
-//#else
-        return tid;
-//#endif
+        return placement_cpu(tid);		//see placement.h for the policies
 }
+#define MAX_NUM_THREADS 288
+typedef struct pool_t pool_t;
 typedef struct 
 {
 	STREAM_TYPE * a;	
 	STREAM_TYPE * b;	
 	STREAM_TYPE * c;
-	uint32_t size;
-	double time;	
-	pthread_barrier_t *barrier;
+	uint32_t *idx;
+	size_t size;
+	size_t reps;							//passes over the slice in one timed run
+	int tid;
+	STREAM_TYPE scalar;
+	STREAM_TYPE sum;						//result of the read kernel
+	double time;
+	cnt_t cnt;								//PHI_COUNTERS of the timed region
+	barrier_t *barrier;
+	pool_t *pool;
 }argc_t;
+/*
+ *	A pool of pinned workers that is created once and reused for every
+ *	iteration and kernel. The main thread hands out a job through the start
+ *	barrier and collects it through the same barrier; the workers-only
+ *	barrier (spinning by default, see barrier.h) brackets the timed region
+ *	inside each kernel.
+ */
+struct pool_t
+{
+	int threads;
+	void *(*job)(void *);					//the kernel to run next, NULL to quit
+	pthread_barrier_t start;				//main thread + workers
+	barrier_t barrier;						//workers only, PHI_BARRIER
+	pthread_t tid[MAX_NUM_THREADS];
+	argc_t info[MAX_NUM_THREADS];
+};
+void *worker (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	pool_t *pool=arg->pool;
+	cnt_open_thread(&arg->cnt, arg->tid);			//the worker is pinned already
+	for (;;)
+	{
+		pthread_barrier_wait(&pool->start);			//wait for a job
+		if (pool->job==NULL)
+			break;
+		pool->job(arg);
+		pthread_barrier_wait(&pool->start);			//report the job done
+	}
+	cnt_close(&arg->cnt);
+	return NULL;
+}
+/* assigns each worker its slice of the first n elements of a, b and c, passed reps times per run */
+void pool_partition (pool_t *pool, size_t n, size_t reps)
+{
+	size_t size=(n/pool->threads) & ~15;
+	int tt;
+
+	for (tt=0;tt<pool->threads;++tt)
+	{
+		pool->info[tt].a=&a[size*tt];
+		pool->info[tt].b=&b[size*tt];
+		pool->info[tt].c=&c[size*tt];
+		pool->info[tt].idx=idx ? &idx[size*tt] : NULL;
+		//the last thread also takes the remainder of the array
+		pool->info[tt].size=(tt==pool->threads-1) ? n-size*tt : size;
+		pool->info[tt].reps=reps;
+	}
+}
+/* creates the workers, pins them and assigns each its slice of the whole arrays */
+void pool_create (pool_t *pool, int threads)
+{
+	pthread_attr_t attr;
+	cpu_set_t set;
+	int tt;
+
+	pool->threads=threads;
+	pool->job=NULL;
+	pthread_barrier_init(&pool->start, NULL, threads+1);
+	barrier_init(&pool->barrier, threads, -1);
+	pool_partition(pool, array_size, 1);
+	for (tt=0;tt<threads;++tt)
+	{
+		pool->info[tt].tid=tt;
+		pool->info[tt].barrier=&pool->barrier;
+		pool->info[tt].pool=pool;
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(get_cpu_id(tt), &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		pthread_create(&pool->tid[tt], &attr, worker, (void*) &pool->info[tt]);
+		pthread_attr_destroy(&attr);
+	}
+}
+/* runs one job on every worker and returns when all of them are done */
+void pool_run (pool_t *pool, void *(*job)(void *))
+{
+	pool->job=job;
+	pthread_barrier_wait(&pool->start);
+	pthread_barrier_wait(&pool->start);
+}
+void pool_destroy (pool_t *pool)
+{
+	int tt;
+	pool->job=NULL;
+	pthread_barrier_wait(&pool->start);
+	for (tt=0;tt<pool->threads;++tt)
+		pthread_join(pool->tid[tt], NULL);
+	pthread_barrier_destroy(&pool->start);
+	barrier_destroy(&pool->barrier);
+}
+/*
+ *	The four STREAM kernels, one partition per thread.
+ *	Each partition starts on a 64-byte boundary; the vector loop covers the
+ *	multiple-of-16 part and the remaining elements are done in scalar code.
+ */
 void *copy (void *parm)
 {
-	uint32_t i=0,j=0;
+	size_t i=0,r;
 	argc_t *arg=(argc_t*)parm;
 	STREAM_TYPE *a=arg->a;
-	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
 	double time;
 	//printf ("%d\n", arg->size);
-	pthread_barrier_wait(arg->barrier);
-	time=mysecond();
-	for (i=0;i<arg->size;i+=16)
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			__m512 key = _mm512_load_ps(&a[i]);
+			_mm512_stream_ps (&c[i], key);
+		}
+		for (;i<arg->size;++i)
+			c[i]=a[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *scale (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
+	__m512 s=_mm512_set1_ps(arg->scalar);
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			__m512 key = _mm512_mul_ps(s, _mm512_load_ps(&c[i]));
+			_mm512_stream_ps (&b[i], key);
+		}
+		for (;i<arg->size;++i)
+			b[i]=arg->scalar*c[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *add (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			__m512 key = _mm512_add_ps(_mm512_load_ps(&a[i]), _mm512_load_ps(&b[i]));
+			_mm512_stream_ps (&c[i], key);
+		}
+		for (;i<arg->size;++i)
+			c[i]=a[i]+b[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *triad (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
+	__m512 s=_mm512_set1_ps(arg->scalar);
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			__m512 key = _mm512_fmadd_ps(s, _mm512_load_ps(&c[i]), _mm512_load_ps(&b[i]));
+			_mm512_stream_ps (&a[i], key);
+		}
+		for (;i<arg->size;++i)
+			a[i]=b[i]+arg->scalar*c[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+/*
+ *	Kernels beyond STREAM, same partitioning and timing. Read is a reduction of a
+ *	with four independent sums, write fills c with streaming stores, store copies
+ *	a to c with regular stores (so every line of c is read for ownership first),
+ *	gather is c[i]=a[idx[i]] and scatter c[idx[i]]=a[i], with the indices of
+ *	PHI_INDEX local to the thread's slice.
+ */
+void *read_only (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	size_t vsize=arg->size & ~63;
+	__m512 s0=_mm512_setzero_ps(), s1=_mm512_setzero_ps(), s2=_mm512_setzero_ps(), s3=_mm512_setzero_ps();
+	STREAM_TYPE sum=0;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=64)
+		{
+			s0 = _mm512_add_ps(s0, _mm512_load_ps(&a[i]));
+			s1 = _mm512_add_ps(s1, _mm512_load_ps(&a[i+16]));
+			s2 = _mm512_add_ps(s2, _mm512_load_ps(&a[i+32]));
+			s3 = _mm512_add_ps(s3, _mm512_load_ps(&a[i+48]));
+		}
+		for (;i<arg->size;++i)
+			sum+=a[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	arg->sum=sum+_mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+	return NULL;
+}
+void *write_only (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
+	__m512 s=_mm512_set1_ps(arg->scalar);
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+			_mm512_stream_ps (&c[i], s);
+		for (;i<arg->size;++i)
+			c[i]=arg->scalar;
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *copy_store (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+			_mm512_store_ps (&c[i], _mm512_load_ps(&a[i]));
+		for (;i<arg->size;++i)
+			c[i]=a[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *gather (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *c=arg->c;
+	uint32_t *idx=arg->idx;
+	size_t vsize=arg->size & ~15;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			__m512i vi = _mm512_load_epi32(&idx[i]);
+			_mm512_stream_ps (&c[i], _mm512_i32gather_ps(vi, a, sizeof(STREAM_TYPE)));
+		}
+		for (;i<arg->size;++i)
+			c[i]=a[idx[i]];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *scatter (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *c=arg->c;
+	uint32_t *idx=arg->idx;
+	size_t vsize=arg->size & ~15;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			__m512i vi = _mm512_load_epi32(&idx[i]);
+			_mm512_i32scatter_ps(c, vi, _mm512_load_ps(&a[i]), sizeof(STREAM_TYPE));
+		}
+		for (;i<arg->size;++i)
+			c[idx[i]]=a[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+
+/*
+ *	The prefetch variants of the STREAM kernels and read, run instead of them
+ *	when PHI_PREFETCH sets a distance. Only the arrays that are read are
+ *	prefetched, the streaming stores do not read for ownership.
+ */
+void *copy_pf (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15, d1=prefetch_l1*LINE_WORDS, d2=prefetch_l2*LINE_WORDS;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			PREFETCH(&a[i], d1, d2);
+			__m512 key = _mm512_load_ps(&a[i]);
+			_mm512_stream_ps (&c[i], key);
+		}
+		for (;i<arg->size;++i)
+			c[i]=a[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *scale_pf (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15, d1=prefetch_l1*LINE_WORDS, d2=prefetch_l2*LINE_WORDS;
+	__m512 s=_mm512_set1_ps(arg->scalar);
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			PREFETCH(&c[i], d1, d2);
+			__m512 key = _mm512_mul_ps(s, _mm512_load_ps(&c[i]));
+			_mm512_stream_ps (&b[i], key);
+		}
+		for (;i<arg->size;++i)
+			b[i]=arg->scalar*c[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *add_pf (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15, d1=prefetch_l1*LINE_WORDS, d2=prefetch_l2*LINE_WORDS;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
 	{
-		__m512 key = _mm512_load_ps(&a[i]);
-		_mm512_stream_ps (&b[i], key);		
+		for (i=0;i<vsize;i+=16)
+		{
+			PREFETCH(&a[i], d1, d2);
+			PREFETCH(&b[i], d1, d2);
+			__m512 key = _mm512_add_ps(_mm512_load_ps(&a[i]), _mm512_load_ps(&b[i]));
+			_mm512_stream_ps (&c[i], key);
+		}
+		for (;i<arg->size;++i)
+			c[i]=a[i]+b[i];
 	}
-	pthread_barrier_wait(arg->barrier);
-	time=mysecond()-time;
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
 	arg->time=time;
-	pthread_exit(NULL);
+	return NULL;
+}
+void *triad_pf (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15, d1=prefetch_l1*LINE_WORDS, d2=prefetch_l2*LINE_WORDS;
+	__m512 s=_mm512_set1_ps(arg->scalar);
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=16)
+		{
+			PREFETCH(&b[i], d1, d2);
+			PREFETCH(&c[i], d1, d2);
+			__m512 key = _mm512_fmadd_ps(s, _mm512_load_ps(&c[i]), _mm512_load_ps(&b[i]));
+			_mm512_stream_ps (&a[i], key);
+		}
+		for (;i<arg->size;++i)
+			a[i]=b[i]+arg->scalar*c[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	return NULL;
+}
+void *read_pf (void *parm)
+{
+	size_t i=0,r;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	size_t vsize=arg->size & ~63, d1=prefetch_l1*LINE_WORDS, d2=prefetch_l2*LINE_WORDS;
+	__m512 s0=_mm512_setzero_ps(), s1=_mm512_setzero_ps(), s2=_mm512_setzero_ps(), s3=_mm512_setzero_ps();
+	STREAM_TYPE sum=0;
+	double time;
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	bi_startTimer();
+	for (r=0;r<arg->reps;++r)
+	{
+		for (i=0;i<vsize;i+=64)
+		{
+			PREFETCH(&a[i], d1, d2);
+			PREFETCH(&a[i+16], d1, d2);
+			PREFETCH(&a[i+32], d1, d2);
+			PREFETCH(&a[i+48], d1, d2);
+			s0 = _mm512_add_ps(s0, _mm512_load_ps(&a[i]));
+			s1 = _mm512_add_ps(s1, _mm512_load_ps(&a[i+16]));
+			s2 = _mm512_add_ps(s2, _mm512_load_ps(&a[i+32]));
+			s3 = _mm512_add_ps(s3, _mm512_load_ps(&a[i+48]));
+		}
+		for (;i<arg->size;++i)
+			sum+=a[i];
+	}
+	barrier_wait(arg->barrier, arg->tid);
+	time=bi_stopTimer();
+	cnt_stop(&arg->cnt);
+	arg->time=time;
+	arg->sum=sum+_mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+	return NULL;
+}
+
+/*
+ *	First touch: every worker initializes its own slice of a, b and c, so the
+ *	pages are faulted in by, and placed near, the core that streams them.
+ *	The indices of gather and scatter are generated here as well.
+ */
+void *init (void *parm)
+{
+	size_t i=0;
+	argc_t *arg=(argc_t*)parm;
+	STREAM_TYPE *a=arg->a;
+	STREAM_TYPE *b=arg->b;
+	STREAM_TYPE *c=arg->c;
+	size_t vsize=arg->size & ~15;
+	__m512 one=_mm512_set1_ps(1.0), two=_mm512_set1_ps(2.0), zero=_mm512_setzero_ps();
+	for (i=0;i<vsize;i+=16)
+	{
+		_mm512_stream_ps (&a[i], one);
+		_mm512_stream_ps (&b[i], two);
+		_mm512_stream_ps (&c[i], zero);
+	}
+	for (;i<arg->size;++i)
+	{
+		a[i]=1.0;
+		b[i]=2.0;
+		c[i]=0.0;
+	}
+	if (arg->idx!=NULL)
+	{
+		rng_t rng;
+		rng_seed(&rng, arg->tid+1);
+		for (i=0;i<arg->size;++i)
+		{
+			if (index_pattern==INDEX_SEQ)
+				arg->idx[i]=i;
+			else if (index_pattern==INDEX_STRIDE)
+				arg->idx[i]=(uint32_t) ((i*(uint64_t) index_stride)%arg->size);
+			else
+				arg->idx[i]=(uint32_t) rng_below(&rng, arg->size);
+		}
+	}
+	_mm_sfence();
+	return NULL;
+}
+
+/* evicts the slices of the worker from the caches and its TLB, before every timed run of --cold */
+void *flush (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	bi_flushRegion(arg->a, arg->size*sizeof(STREAM_TYPE));
+	bi_flushRegion(arg->b, arg->size*sizeof(STREAM_TYPE));
+	bi_flushRegion(arg->c, arg->size*sizeof(STREAM_TYPE));
+	if (arg->idx!=NULL)
+		bi_flushRegion(arg->idx, arg->size*sizeof(uint32_t));
+	bi_flushTLB();
+	return NULL;
+}
+
+/*
+ *	The selectable kernels; words is the number of STREAM_TYPE sized words
+ *	moved per element, counted the STREAM way (no read for ownership).
+ *	The first four are STREAM, and the only ones that are validated.
+ */
+typedef struct
+{
+	const char *name;
+	char *label;
+	void *(*run)(void *);
+	int words;
+	void *(*prefetch)(void *);				//the variant with software prefetches, NULL if none
+}kernel_t;
+static kernel_t kernel[MAX_KERNELS] = {
+	{"copy", "Copy:      ", copy, 2, copy_pf},
+	{"scale", "Scale:     ", scale, 2, scale_pf},
+	{"add", "Add:       ", add, 3, add_pf},
+	{"triad", "Triad:     ", triad, 3, triad_pf},
+	{"read", "Read:      ", read_only, 1, read_pf},
+	{"write", "Write:     ", write_only, 1, NULL},
+	{"store", "Store copy:", copy_store, 2, NULL},
+	{"gather", "Gather:    ", gather, 3, NULL},				//index, gathered element, stored element
+	{"scatter", "Scatter:   ", scatter, 3, NULL},
+};
+
+/* parses a comma separated list of kernel names, or "all"; returns the number of kernels or -1 */
+static int parse_kernels(const char *list, int *sel)
+{
+	char buf[256], *name, *save=NULL;
+	int n=0, k;
+	if (strcmp(list, "all")==0)
+	{
+		for (k=0;k<MAX_KERNELS;++k)
+			sel[n++]=k;
+		return n;
+	}
+	strncpy(buf, list, sizeof(buf)-1);
+	buf[sizeof(buf)-1]='\0';
+	for (name=strtok_r(buf, ",", &save); name!=NULL; name=strtok_r(NULL, ",", &save))
+	{
+		for (k=0;k<MAX_KERNELS;++k)
+			if (strcmp(name, kernel[k].name)==0)
+				break;
+		if (k==MAX_KERNELS || n==MAX_KERNELS)
+			return -1;
+		sel[n++]=k;
+	}
+	return n;
+}
+
+/* reads PHI_INDEX, the index pattern of gather and scatter: seq, stride:<elements> or random */
+static void parse_index(void)
+{
+	const char *pattern=getenv("PHI_INDEX");
+	if (pattern!=NULL && strcmp(pattern, "seq")==0)
+		index_pattern=INDEX_SEQ;
+	else if (pattern!=NULL && strncmp(pattern, "stride:", 7)==0)
+	{
+		index_pattern=INDEX_STRIDE;
+		index_stride=atol(pattern+7);
+	}
+}
+/* parses a comma separated list of at most PREFETCH_MAX distances; returns their number or -1 */
+static int parse_distances(char *list, long *d)
+{
+	char *tok, *end, *save=NULL;
+	int n=0;
+	for (tok=strtok_r(list, ",", &save); tok!=NULL; tok=strtok_r(NULL, ",", &save))
+	{
+		if (n==PREFETCH_MAX)
+			return -1;
+		d[n]=strtol(tok, &end, 10);
+		if (end==tok || *end!='\0' || d[n]<0)
+			return -1;
+		n++;
+	}
+	return n>0 ? n : -1;
+}
+/*
+ *	Sets the prefetch distances, spec is as for PHI_PREFETCH: NULL or "off" for
+ *	none, "<L1 lines>:<L2 lines>", lists of both to measure every pair after the
+ *	baseline without prefetching, or "sweep" for the lists prefetch_sweep_l1/l2
+ */
+int bandwidth_prefetch(const char *spec)
+{
+	char buf[256], *l2;
+	int k;
+
+	nprefetch_l1=nprefetch_l2=1;
+	prefetch_l1s[0]=prefetch_l2s[0]=0;
+	snprintf(prefetch_spec, sizeof(prefetch_spec), "%s", spec ? spec : "off");
+	if (spec==NULL || strcmp(spec, "off")==0)
+		return 0;
+	if (strcmp(spec, "sweep")==0)
+	{
+		nprefetch_l1=sizeof(prefetch_sweep_l1)/sizeof(long);
+		nprefetch_l2=sizeof(prefetch_sweep_l2)/sizeof(long);
+		for (k=0;k<nprefetch_l1;++k)
+			prefetch_l1s[k]=prefetch_sweep_l1[k];
+		for (k=0;k<nprefetch_l2;++k)
+			prefetch_l2s[k]=prefetch_sweep_l2[k];
+		return 0;
+	}
+	snprintf(buf, sizeof(buf), "%s", spec);
+	if ((l2=strchr(buf, ':'))!=NULL)
+		*l2++='\0';
+	if (l2==NULL || (nprefetch_l1=parse_distances(buf, prefetch_l1s))<1 || (nprefetch_l2=parse_distances(l2, prefetch_l2s))<1)
+	{
+		printf("PHI_PREFETCH must be off, <L1 lines>:<L2 lines> with comma separated lists of distances, or sweep\n");
+		bandwidth_prefetch(NULL);
+		return -1;
+	}
+	return 0;
+}
+/* nonzero if more than one pair of prefetch distances is measured */
+static int prefetch_grid(void)
+{
+	return nprefetch_l1*nprefetch_l2>1;
+}
+/* returns nonzero if one of the selected kernels needs the indices */
+static int needs_index(const int *sel, int nsel)
+{
+	int kk;
+	for (kk=0; kk<nsel; ++kk)
+		if (kernel[sel[kk]].run==gather || kernel[sel[kk]].run==scatter)
+			return 1;
+	return 0;
+}
+/* the passes over n elements per array that move at least SWEEP_MIN_BYTES in one timed run, one if cold */
+static size_t min_reps(size_t n)
+{
+	if (bi_cold)
+		return 1;
+	return (SWEEP_MIN_BYTES+n*sizeof(STREAM_TYPE)-1)/(n*sizeof(STREAM_TYPE));
+}
+/* where the arrays are, one kind or a=<kind>,b=<kind>,c=<kind> */
+static const char *memory_name(void)
+{
+	static char name[128];
+	if (mem_kind_of(a)==mem_kind_of(b) && mem_kind_of(a)==mem_kind_of(c))
+		snprintf(name, sizeof(name), "%s", mem_kind_name(mem_kind_of(a)));
+	else
+		snprintf(name, sizeof(name), "a=%s,b=%s,c=%s", mem_kind_name(mem_kind_of(a)), mem_kind_name(mem_kind_of(b)), mem_kind_name(mem_kind_of(c)));
+	return name;
+}
+/* the pages the arrays got, one size or a=<size>,b=<size>,c=<size> */
+static const char *pages_name(void)
+{
+	static char name[64];
+	if (strcmp(mem_page_of(a), mem_page_of(b))==0 && strcmp(mem_page_of(a), mem_page_of(c))==0)
+		snprintf(name, sizeof(name), "%s", mem_page_of(a));
+	else
+		snprintf(name, sizeof(name), "a=%s,b=%s,c=%s", mem_page_of(a), mem_page_of(b), mem_page_of(c));
+	return name;
+}
+/* prints where the arrays are, the page size, the index pattern and the prefetch distances */
+static void print_memory(void)
+{
+	printf("Memory:\t%s\t", memory_name());
+	printf("Pages:\t%s\tCache:\t%s\n", pages_name(), bi_cache_name());
+	if (idx!=NULL)
+	{
+		if (index_pattern==INDEX_STRIDE)
+			printf("Index:\tstride:%ld\n", index_stride);
+		else
+			printf("Index:\t%s\n", index_pattern==INDEX_SEQ ? "seq" : "random");
+	}
+	if (strcmp(prefetch_spec, "off")!=0)
+		printf("Prefetch:\t%s\n", prefetch_spec);
+}
+/* run k of the selected kernels on the pool, each timed as the average over the threads */
+static void run_kernels(pool_t *pool, const int *sel, int nsel, double times[][ADAPT_MAX_RUNS], int k)
+{
+	int kk, tt;
+	for (kk=0; kk<nsel; ++kk)
+	{
+		times[kk][k]=0;
+		if (bi_cold)
+			pool_run(pool, flush);
+		if (k>0)
+			pwr_begin(&power[kk], pool->threads);
+		if ((prefetch_l1 || prefetch_l2) && kernel[sel[kk]].prefetch!=NULL)
+			pool_run(pool, kernel[sel[kk]].prefetch);
+		else
+			pool_run(pool, kernel[sel[kk]].run);
+		if (k>0)
+			pwr_end(&power[kk]);
+		for (tt = 0 ; tt != pool->threads ; ++tt)
+		{
+			times[kk][k]+=pool->info[tt].time;
+			if (k>0)
+				cnt_add(counts[kk], &pool->info[tt].cnt);
+		}
+		times[kk][k] = times[kk][k]/pool->threads;
+	}
+}
+/*
+ *	Runs the selected kernels on the pool, partitioned into n elements passed *reps times,
+ *	and returns the number of runs: NTIMES, or with PHI_PRECISION, after *reps has been
+ *	raised until every run is long enough, as many as the kernels need (ad[kernel])
+ */
+static int run_times(pool_t *pool, const int *sel, int nsel, double times[][ADAPT_MAX_RUNS], size_t n, size_t *reps, adapt_t *ad)
+{
+	int k, kk, more;
+	double shortest;
+	size_t r;
+
+	if (!adapt_enabled())
+	{
+		for (k=0; k<NTIMES; k++)
+			run_kernels(pool, sel, nsel, times, k);
+		return NTIMES;
+	}
+	//the first run, not reported, is repeated until the shortest kernel is long enough; cold runs are one pass
+	for (;;)
+	{
+		run_kernels(pool, sel, nsel, times, 0);
+		for (shortest=times[0][0], kk=1; kk<nsel; ++kk)
+			shortest=MIN(shortest, times[kk][0]);
+		r = bi_cold ? *reps : (size_t) adapt_scale(*reps, shortest);
+		if (r==*reps)
+			break;
+		pool_partition(pool, n, *reps=r);
+	}
+	for (kk=0; kk<nsel; ++kk)
+		adapt_begin(&ad[kk]);
+	for (k=1, more=1; more && k<ADAPT_MAX_RUNS; k++)
+	{
+		run_kernels(pool, sel, nsel, times, k);
+		for (more=0, kk=0; kk<nsel; ++kk)
+			more|=adapt_more(&ad[kk], times[kk][k]);
+	}
+	return k;
+}
+/*
+ *	prints the best rate of every kernel over the runs after the first, of n elements per array
+ *	passed reps times, with the frequency and power of the runs and their precision in ad if
+ *	it is not NULL
+ */
+static void report(double times[][ADAPT_MAX_RUNS], int runs, const int *sel, int nsel, int threads, size_t n, size_t reps, int sized, const adapt_t *ad)
+{
+	int j, k;
+
+	for (j=0; j<nsel; j++)
+	{
+		avgtime[j] = maxtime[j] = 0;
+		mintime[j] = FLT_MAX;
+	}
+	for (k=1; k<runs; k++) /* note -- skip first iteration */
+	{
+		for (j=0; j<nsel; j++)
+		{
+			avgtime[j] = avgtime[j] + times[j][k];
+			mintime[j] = MIN(mintime[j], times[j][k]);
+			maxtime[j] = MAX(maxtime[j], times[j][k]);
+		}
+	}
+
+	//printf("Function    Best Rate MB/s  Avg time     Min time     Max time\n");
+	for (j=0; j<nsel; j++) {
+		double bytes = (double) kernel[sel[j]].words * sizeof(STREAM_TYPE) * n * reps;
+		avgtime[j] = avgtime[j]/(double)(runs-1);
+
+		if (sized)
+			printf("Size:\t%lu bytes\t", (unsigned long) (n*sizeof(STREAM_TYPE)));
+		if (strcmp(prefetch_spec, "off")!=0)
+			printf("Prefetch L1:\t%ld\tL2:\t%ld\t", prefetch_l1, prefetch_l2);
+		printf("Threads:\t%d\t%sRead and write bandwidth (MB/s):\t%12.1f", threads, kernel[sel[j]].label, 1.0E-06 * bytes/mintime[j]);
+		pwr_print(&power[j], 1.0E-09 * bytes/mintime[j], "GB/s");
+		if (ad!=NULL)
+			adapt_print(&ad[j]);
+		cnt_print(counts[j], bytes*(runs-1), "byte");
+		printf("\n");
+		if (result_enabled())
+		{
+			//the same runs as the best rate, every one the average time of the threads
+			char params[512];
+			result_t r={"bandwidth", kernel[sel[j]].name, "MB/s", 1.0E-06 * bytes/mintime[j], &times[j][1], runs-1,
+				threads, (long) (n*sizeof(STREAM_TYPE)), memory_name(), params, pages_name()};
+			if (kernel[sel[j]].run==gather || kernel[sel[j]].run==scatter)
+			{
+				if (index_pattern==INDEX_STRIDE)
+					snprintf(params, sizeof(params), "reps=%lu;index=stride:%ld", (unsigned long) reps, index_stride);
+				else
+					snprintf(params, sizeof(params), "reps=%lu;index=%s", (unsigned long) reps, index_pattern==INDEX_SEQ ? "seq" : "random");
+			}
+			else
+				snprintf(params, sizeof(params), "reps=%lu", (unsigned long) reps);
+			if (strcmp(prefetch_spec, "off")!=0)
+				snprintf(params+strlen(params), sizeof(params)-strlen(params), ";prefetch=%ld:%ld", prefetch_l1, prefetch_l2);
+			pwr_params(params, sizeof(params), &power[j], 1.0E-09 * bytes/mintime[j], "GB/s");
+			if (ad!=NULL)
+				adapt_params(params, sizeof(params), &ad[j]);
+			cnt_params(params, sizeof(params), counts[j], bytes*(runs-1), "byte");
+			result_emit(&r);
+		}
+		memset(counts[j], 0, sizeof(counts[j]));
+		pwr_reset(&power[j]);
+	}
+	fflush(stdout);
+}
+/*
+ *	Runs the selected kernels NTIMES on the first n elements of the arrays and reports
+ *	them. With several pairs of prefetch distances, the baseline without prefetching
+ *	runs all of them first, then every other pair the kernels with a prefetch variant,
+ *	and the best pair of every kernel is printed last.
+ */
+static void run_point(pool_t *pool, const int *sel, int nsel, size_t n, size_t reps, int sized)
+{
+	static double times[MAX_KERNELS][ADAPT_MAX_RUNS];
+	double best[MAX_KERNELS], base[MAX_KERNELS];
+	long best_l1[MAX_KERNELS], best_l2[MAX_KERNELS];
+	int psel[MAX_KERNELS], npsel=0, i, j, kk, runs;
+	adapt_t ad[MAX_KERNELS];
+
+	prefetch_l1=prefetch_l1s[0];
+	prefetch_l2=prefetch_l2s[0];
+	if (prefetch_grid())
+		prefetch_l1=prefetch_l2=0;
+	runs=run_times(pool, sel, nsel, times, n, &reps, ad);
+	report(times, runs, sel, nsel, pool->threads, n, reps, sized, adapt_enabled() ? ad : NULL);
+	if (!prefetch_grid())
+		return;
+	for (kk=0; kk<nsel; ++kk)
+		if (kernel[sel[kk]].prefetch!=NULL)
+		{
+			base[npsel]=best[npsel]=1.0E-06 * kernel[sel[kk]].words * sizeof(STREAM_TYPE) * n * reps/mintime[kk];
+			best_l1[npsel]=best_l2[npsel]=0;
+			psel[npsel++]=sel[kk];
+		}
+	for (i=0; i<nprefetch_l1 && npsel>0; ++i)
+		for (j=0; j<nprefetch_l2; ++j)
+		{
+			if (prefetch_l1s[i]==0 && prefetch_l2s[j]==0)
+				continue;
+			prefetch_l1=prefetch_l1s[i];
+			prefetch_l2=prefetch_l2s[j];
+			runs=run_times(pool, psel, npsel, times, n, &reps, ad);
+			report(times, runs, psel, npsel, pool->threads, n, reps, sized, adapt_enabled() ? ad : NULL);
+			for (kk=0; kk<npsel; ++kk)
+			{
+				double rate=1.0E-06 * kernel[psel[kk]].words * sizeof(STREAM_TYPE) * n * reps/mintime[kk];
+				if (rate>best[kk])
+				{
+					best[kk]=rate;
+					best_l1[kk]=prefetch_l1;
+					best_l2[kk]=prefetch_l2;
+				}
+			}
+		}
+	for (kk=0; kk<npsel; ++kk)
+	{
+		if (sized)
+			printf("Size:\t%lu bytes\t", (unsigned long) (n*sizeof(STREAM_TYPE)));
+		printf("Threads:\t%d\t%sBest prefetch L1:\t%ld\tL2:\t%ld\tRead and write bandwidth (MB/s):\t%12.1f\tWithout prefetch (MB/s):\t%12.1f\n",
+			pool->threads, kernel[psel[kk]].label, best_l1[kk], best_l2[kk], best[kk], base[kk]);
+		if (result_enabled())
+		{
+			char params[128];
+			result_t r={"prefetch", kernel[psel[kk]].name, "MB/s", best[kk], NULL, 0,
+				pool->threads, (long) (n*sizeof(STREAM_TYPE)), memory_name(), params, pages_name()};
+			snprintf(params, sizeof(params), "reps=%lu;l1=%ld;l2=%ld;baseline=%.1f", (unsigned long) reps, best_l1[kk], best_l2[kk], base[kk]);
+			result_emit(&r);
+		}
+	}
+	fflush(stdout);
+}
+
+/*
+ *	Entry points of the in-process driver (bench.h): the arrays are allocated and first
+ *	touched once by bandwidth_setup(), every point reuses them with the pool of bandwidth_start()
+ */
+static pool_t	driver_pool;
+static int	driver_sel[MAX_KERNELS], driver_nsel;
+
+int bandwidth_setup(size_t bytes, const char *kernels, int threads)
+{
+	size_t n=bytes/sizeof(STREAM_TYPE)/16*16;
+	if ((driver_nsel=parse_kernels(kernels, driver_sel))<1)
+	{
+		printf("Unknown kernels \"%s\"\n", kernels);
+		return -1;
+	}
+	array_size=n;
+	a=mem_alloc(sizeof(STREAM_TYPE)*array_size+OFFSET, mem_kind_for("a"));
+	b=mem_alloc(sizeof(STREAM_TYPE)*array_size+OFFSET, mem_kind_for("b"));
+	c=mem_alloc(sizeof(STREAM_TYPE)*array_size+OFFSET, mem_kind_for("c"));
+	if (needs_index(driver_sel, driver_nsel))
+	{
+		parse_index();
+		idx=mem_alloc(sizeof(uint32_t)*array_size, mem_kind_for("idx"));
+	}
+	if (a==NULL || b==NULL || c==NULL || (needs_index(driver_sel, driver_nsel) && idx==NULL))
+	{
+		printf("Cannot allocate the arrays\n");
+		bandwidth_teardown();
+		return -1;
+	}
+	//parallel first touch, the following points only run the kernels
+	if (bandwidth_start(threads)!=0)
+	{
+		bandwidth_teardown();
+		return -1;
+	}
+	pool_run(&driver_pool, init);
+	bandwidth_stop();
+	print_memory();
+	return 0;
+}
+void bandwidth_teardown(void)
+{
+	mem_free(a);
+	mem_free(b);
+	mem_free(c);
+	mem_free(idx);
+	a=b=c=NULL;
+	idx=NULL;
+}
+int bandwidth_start(int threads)
+{
+	int tt;
+	if (threads<1 || threads>MAX_NUM_THREADS)
+	{
+		printf("The number of threads must be between 1 and %d\n", MAX_NUM_THREADS);
+		return -1;
+	}
+	pool_create(&driver_pool, threads);
+	for (tt=0;tt<threads;++tt)
+		driver_pool.info[tt].scalar=3.0;
+	return 0;
 }
+void bandwidth_stop(void)
+{
+	pool_destroy(&driver_pool);
+}
+int bandwidth_run(size_t bytes)
+{
+	size_t n=bytes/sizeof(STREAM_TYPE)/16*16, reps;
 
+	//the indices are 32-bit and local to the slice of a thread
+	if (n>array_size || n<(size_t) driver_pool.threads*16 || (idx!=NULL && n/driver_pool.threads+16>INT32_MAX))
+	{
+		printf("Cannot run %d threads on arrays of %lu elements\n", driver_pool.threads, (unsigned long) n);
+		return -1;
+	}
+	reps=min_reps(n);
+	pool_partition(&driver_pool, n, reps);
+	run_point(&driver_pool, driver_sel, driver_nsel, n, reps, 1);
+	return 0;
+}
 
+#ifndef PHI_DRIVER
 int main(int argc, char **argv)
 {
 	int			quantum, checktick();
@@ -230,26 +1269,13 @@ int main(int argc, char **argv)
 	int			k;
 	ssize_t		j;
 	STREAM_TYPE		scalar;
-	double		t, times[4][NTIMES];
+	double		t;
+#ifdef MP
+	static double	times[MAX_KERNELS][ADAPT_MAX_RUNS];
+#endif
+	int			sel[MAX_KERNELS] = {0, 1, 2, 3}, nsel = 4, stream;
 	
-	#ifdef MCDRAM
-	if (hbw_check_available())//returns zero if hbw_malloc is availiable.
-	{
-		posix_memalign(&a, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-		posix_memalign(&b, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-		posix_memalign(&c, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-	}
-	else
-	{
-		hbw_posix_memalign(&a, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-		hbw_posix_memalign(&b, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-		hbw_posix_memalign(&c, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-	}
-	#else
-		posix_memalign((void**)&a, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-		posix_memalign((void**)&b, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-		posix_memalign((void**)&c, 64, sizeof(STREAM_TYPE)*STREAM_ARRAY_SIZE+OFFSET);
-	#endif
+	mem_init();
 
 	/* --- SETUP --- determine precision and check timing --- */
 
@@ -257,101 +1283,208 @@ int main(int argc, char **argv)
 	//printf("STREAM version $Revision: 5.10 $\n");
 	//printf(HLINE);
 	BytesPerWord = sizeof(STREAM_TYPE);
+	bi_timer_init();
+	placement_init();
+	result_init();
+	cnt_init();
+	adapt_init();
+	pwr_init();
+	argc=bi_cache_args(argc, argv);
 	//printf("This system uses %d bytes per array element.\n",
 	//BytesPerWord);
 
 	//printf(HLINE);
-	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+scalar = 3.0;
+float tc=0;
+int tt, threads;
+//"sweep" shifts the arguments: sweep <threads> [kernels] [min KB] [max KB]
+int sweep = argc>1 && strcmp(argv[1], "sweep")==0;
+size_t min_size, sizes[256], reps[256];
+int si, nsizes=0;
+
+if (argc<2+sweep)
+{
+	printf("Usage: %s [--cold] <threads> [kernels] [MB per array] | [--cold] sweep <threads> [kernels] [min KB] [max KB]\n", argv[0]);
+	return 1;
+}
+threads=atoll(argv[1+sweep]);
+if (threads<1 || threads>MAX_NUM_THREADS)
+{
+	printf("The number of threads must be between 1 and %d\n", MAX_NUM_THREADS);
+	return 1;
+}
+if (bandwidth_prefetch(getenv("PHI_PREFETCH"))!=0)
+	return 1;
+#ifdef MP
+if (prefetch_grid())
+{
+	printf("The prefetch distances are measured by the worker pool, build without -DMP\n");
+	return 1;
+}
+#endif
+if (sweep)
+{
+	min_size = argc>3+sweep ? atol(argv[3+sweep])*1024 : SWEEP_MIN_SIZE;
+	array_size = argc>4+sweep ? atol(argv[4+sweep])*1024/sizeof(STREAM_TYPE) : array_size;
+}
+else if (argc>3)
+	array_size = atol(argv[3])*1024*1024/sizeof(STREAM_TYPE);
+if (sweep)
+{
+	//geometric sizes per array from min_size to array_size, each repeated to move SWEEP_MIN_BYTES
+	double bytes, factor=pow(2.0, 1.0/SWEEP_STEPS_PER_OCTAVE);
+	for (bytes=min_size; bytes<=array_size*sizeof(STREAM_TYPE)*1.0001 && nsizes<256; bytes*=factor)
+	{
+		size_t n=((size_t) (bytes+0.5))/sizeof(STREAM_TYPE)/16*16;
+		if (n==0 || (nsizes>0 && n==sizes[nsizes-1]))
+			continue;
+		sizes[nsizes]=n;
+		reps[nsizes]=min_reps(n);
+		nsizes++;
+	}
+}
+else
+{
+	sizes[nsizes]=array_size;
+	reps[nsizes++]=1;
+}
+#ifdef MP
+if (sweep)
+{
+	printf("The sweep needs the worker pool, build without -DMP\n");
+	return 1;
+}
+#endif
+if (nsizes==0 || array_size<(size_t) threads)
+{
+	printf("Cannot run %d threads on arrays of %lu elements\n", threads, (unsigned long) array_size);
+	return 1;
+}
+//every array where PHI_MEMORY puts it, by default MCDRAM in MCDRAM builds (if there is any) and DDR otherwise
+a=mem_alloc(sizeof(STREAM_TYPE)*array_size+OFFSET, mem_kind_for("a"));
+b=mem_alloc(sizeof(STREAM_TYPE)*array_size+OFFSET, mem_kind_for("b"));
+c=mem_alloc(sizeof(STREAM_TYPE)*array_size+OFFSET, mem_kind_for("c"));
+if (a==NULL || b==NULL || c==NULL)
+{
+	printf("Cannot allocate the arrays\n");
+	return 1;
+}
+#ifdef MP
+	for (j=0; j<array_size; j++) {
 		a[j] = 1.0;
 		b[j] = 2.0;
-		//c[j] = 0.0;
+		c[j] = 0.0;
 	}
+#endif
 
 /*	--- MAIN LOOP --- repeat test cases NTIMES times --- */
 
-scalar = 3.0;
-float tc=0;
-int tt, threads;
-
-threads=atoll(argv[1]);
-//prepare for the pthread
-pthread_t tid[288];
-pthread_attr_t attr[288];
-cpu_set_t set;
-argc_t info[288];
+#ifndef MP
+//the kernels to run, STREAM Copy, Scale, Add and Triad by default
+if (argc>2+sweep && (nsel=parse_kernels(argv[2+sweep], sel))<1)
+{
+	printf("Kernels are a comma separated list of copy, scale, add, triad, read, write, store, gather, scatter, or all\n");
+	return 1;
+}
+#endif
+stream = nsel==4 && sel[0]==0 && sel[1]==1 && sel[2]==2 && sel[3]==3;
+if (needs_index(sel, nsel))
+{
+	parse_index();
+	idx=mem_alloc(sizeof(uint32_t)*array_size, mem_kind_for("idx"));
+	//the indices are 32-bit and local to the slice of a thread
+	if (idx==NULL || array_size/threads+16>INT32_MAX)
+	{
+		printf("Cannot allocate the indices\n");
+		return 1;
+	}
+}
+#ifndef MP
+//create the pinned workers once, they are reused for every iteration and kernel
+static pool_t pool;
+pool_create(&pool, threads);
+for (tt=0;tt<threads;++tt)
+	pool.info[tt].scalar=scalar;
+//parallel first touch of the arrays, before anything is timed
+pool_run(&pool, init);
+#endif
+print_memory();
 
+for (si=0; si<nsizes; si++)
+{
+#ifndef MP
+if (sweep)
+	pool_partition(&pool, sizes[si], reps[si]);
+//run the selected kernels, Copy, Scale, Add and Triad in the STREAM order by default, at every pair of prefetch distances
+run_point(&pool, sel, nsel, sizes[si], reps[si], sweep);
+#else
 
 for (k=0; k<NTIMES; k++)
 {
 	
-#ifdef MP
-	times[0][k] = mysecond();
+	times[0][k] = bi_gettime();
 #ifdef TUNED
 	tuned_STREAM_Copy();
 #else
 
-	for (j=0; j<STREAM_ARRAY_SIZE; j+=1)
+	for (j=0; j<array_size; j+=1)
 	{
-		b[j]=a[j];
+		c[j]=a[j];
 	}
 	//_mm512_storenrngo_ps(&c[0], temp);
 #endif
-	times[0][k]=mysecond()-times[0][k];
+	times[0][k]=bi_gettime()-times[0][k];
+	times[1][k] = bi_gettime();
+#ifdef TUNED
+	tuned_STREAM_Scale(scalar);
 #else
-	times[0][k]=0;
-	//times[0][k] = mysecond();
-	pthread_barrier_t barrier;
-	pthread_barrier_init(&barrier, NULL, threads);
-	for (tt=0;tt<threads;++tt)
-	{
-		uint32_t size=(STREAM_ARRAY_SIZE/threads) & ~15;
-		pthread_attr_init(&attr[tt]);
-		CPU_ZERO(&set);
-		CPU_SET(get_cpu_id(tt), &set);
-		pthread_attr_setaffinity_np(&attr[tt], sizeof(cpu_set_t), &set);
-		info[tt].a=&a[size*tt];
-		info[tt].b=&b[size*tt];
-		info[tt].c=&c[size*tt];
-		info[tt].barrier=&barrier;
-		info[tt].size=size;
-	}
-	//times[0][k] = mysecond();
-	for (tt=0;tt<threads;++tt)
-	{	
-		pthread_create(&tid[tt], &attr[tt], copy, (void*) &info[tt]);		
-	}	
-	for (tt = 0 ; tt != threads ; ++tt)
-	{
-		pthread_join(tid[tt], NULL);
-		times[0][k]+=info[tt].time;
-	}
-	times[0][k] = times[0][k]/threads;
+	for (j=0; j<array_size; j+=1)
+		b[j]=scalar*c[j];
 #endif
+	times[1][k]=bi_gettime()-times[1][k];
+	times[2][k] = bi_gettime();
+#ifdef TUNED
+	tuned_STREAM_Add();
+#else
+	for (j=0; j<array_size; j+=1)
+		c[j]=a[j]+b[j];
+#endif
+	times[2][k]=bi_gettime()-times[2][k];
+	times[3][k] = bi_gettime();
+#ifdef TUNED
+	tuned_STREAM_Triad(scalar);
+#else
+	for (j=0; j<array_size; j+=1)
+		a[j]=b[j]+scalar*c[j];
+#endif
+	times[3][k]=bi_gettime()-times[3][k];
 
 
 	}
 
 /*	--- SUMMARY --- */
 
-for (k=1; k<NTIMES; k++) /* note -- skip first iteration */
-{
-	for (j=0; j<1; j++)
-	{
-		avgtime[j] = avgtime[j] + times[j][k];
-		mintime[j] = MIN(mintime[j], times[j][k]);
-		maxtime[j] = MAX(maxtime[j], times[j][k]);
-	}
+report(times, NTIMES, sel, nsel, threads, sizes[si], reps[si], sweep, NULL);
+#endif
 }
-
-//printf("Function    Best Rate MB/s  Avg time     Min time     Max time\n");
-
-for (j=0; j<1; j++) {
-	avgtime[j] = avgtime[j]/(double)(NTIMES-1);
-
-	printf("Threads:\t%d\tRead and write bandwidth (MB/s):\t%12.1f\n", threads,1.0E-06 * bytes[j]/mintime[j]);
+#ifndef MP
+pool_destroy(&pool);
+#endif
+mem_free(idx);
+//only the STREAM sequence over the whole arrays leaves them in a known state
+if (sweep || !stream || prefetch_grid())
+	return 0;
+#ifndef MP
+//the adaptive runs pass the arrays hundreds of times, far beyond the range of the expected values
+if (adapt_enabled())
+{
+	printf("Validation:\tskipped with PHI_PRECISION\n");
+	return 0;
 }
-return 0;
+#endif
+return checkSTREAMresults() ? 1 : 0;
 }
+#endif
 
 # define	M	20
 
@@ -362,8 +1495,8 @@ checktick()
 	double	t1, t2, timesfound[M];
 
 	for (i = 0; i < M; i++) {
-		t1 = mysecond();
-		while( ((t2=mysecond()) - t1) < 1.0E-6 )
+		t1 = bi_gettime();
+		while( ((t2=bi_gettime()) - t1) < 1.0E-6 )
 			;
 		timesfound[i] = t1 = t2;
 	}
@@ -385,39 +1518,22 @@ checktick()
 
 
 
-/* A gettimeofday routine to give access to the wall
-   clock timer on most UNIX-like systems.  */
-
-#include <sys/time.h>
-
-double mysecond()
-{
-	struct timeval tp;
-	struct timezone tzp;
-	int i;
-
-	i = gettimeofday(&tp,&tzp);
-	return ( (double) tp.tv_sec + (double) tp.tv_usec * 1.e-6 );
-}
-
 #ifndef abs
 #define abs(a) ((a) >= 0 ? (a) : -(a))
 #endif
-void checkSTREAMresults ()
+int checkSTREAMresults ()
 {
 	STREAM_TYPE aj,bj,cj,scalar;
 	STREAM_TYPE aSumErr,bSumErr,cSumErr;
 	STREAM_TYPE aAvgErr,bAvgErr,cAvgErr;
 	double epsilon;
-	ssize_t	j;
+	size_t	j;
 	int	k,ierr,err;
 
 	/* reproduce initialization */
 	aj = 1.0;
 	bj = 2.0;
 	cj = 0.0;
-	/* a[] is modified during timing check */
-	aj = 2.0E0 * aj;
 	/* now execute timing loop */
 	scalar = 3.0;
 	for (k=0; k<NTIMES; k++)
@@ -432,15 +1548,15 @@ void checkSTREAMresults ()
 	aSumErr = 0.0;
 	bSumErr = 0.0;
 	cSumErr = 0.0;
-	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+	for (j=0; j<array_size; j++) {
 		aSumErr += abs(a[j] - aj);
 		bSumErr += abs(b[j] - bj);
 		cSumErr += abs(c[j] - cj);
 		// if (j == 417) //printf("Index 417: c[j]: %f, cj: %f\n",c[j],cj);	// MCCALPIN
 	}
-	aAvgErr = aSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-	bAvgErr = bSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-	cAvgErr = cSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
+	aAvgErr = aSumErr / (STREAM_TYPE) array_size;
+	bAvgErr = bSumErr / (STREAM_TYPE) array_size;
+	cAvgErr = cSumErr / (STREAM_TYPE) array_size;
 
 	if (sizeof(STREAM_TYPE) == 4) {
 		epsilon = 1.e-6;
@@ -456,69 +1572,70 @@ void checkSTREAMresults ()
 	err = 0;
 	if (abs(aAvgErr/aj) > epsilon) {
 		err++;
-		//printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		//printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
+		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
+		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<array_size; j++) {
 			if (abs(a[j]/aj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
 				if (ierr < 10) {
-					//printf("         array a: index: %ld, expected: %e, observed: %e, relative error: %e\n",
+					printf("         array a: index: %zu, expected: %e, observed: %e, relative error: %e\n",
 					j,aj,a[j],abs((aj-a[j])/aAvgErr));
 				}
 #endif
 			}
 		}
-		//printf("     For array a[], %d errors were found.\n",ierr);
+		printf("     For array a[], %d errors were found.\n",ierr);
 	}
 	if (abs(bAvgErr/bj) > epsilon) {
 		err++;
-		//printf ("Failed Validation on array b[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		//printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
-		//printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
+		printf ("Failed Validation on array b[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
+		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
+		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<array_size; j++) {
 			if (abs(b[j]/bj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
 				if (ierr < 10) {
-					//printf("         array b: index: %ld, expected: %e, observed: %e, relative error: %e\n",
+					printf("         array b: index: %zu, expected: %e, observed: %e, relative error: %e\n",
 					j,bj,b[j],abs((bj-b[j])/bAvgErr));
 				}
 #endif
 			}
 		}
-		//printf("     For array b[], %d errors were found.\n",ierr);
+		printf("     For array b[], %d errors were found.\n",ierr);
 	}
 	if (abs(cAvgErr/cj) > epsilon) {
 		err++;
-		//printf ("Failed Validation on array c[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		//printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
-		//printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
+		printf ("Failed Validation on array c[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
+		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
+		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<array_size; j++) {
 			if (abs(c[j]/cj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
 				if (ierr < 10) {
-					//printf("         array c: index: %ld, expected: %e, observed: %e, relative error: %e\n",
+					printf("         array c: index: %zu, expected: %e, observed: %e, relative error: %e\n",
 					j,cj,c[j],abs((cj-c[j])/cAvgErr));
 				}
 #endif
 			}
 		}
-		//printf("     For array c[], %d errors were found.\n",ierr);
+		printf("     For array c[], %d errors were found.\n",ierr);
 	}
 	if (err == 0) {
 		//printf ("Solution Validates: avg error less than %e on all three arrays\n",epsilon);
 	}
 #ifdef VERBOSE
-	//printf ("Results Validation Verbose Results: \n");
-	//printf ("    Expected a(1), b(1), c(1): %f %f %f \n",aj,bj,cj);
-	//printf ("    Observed a(1), b(1), c(1): %f %f %f \n",a[1],b[1],c[1]);
-	//printf ("    Rel Errors on a, b, c:     %e %e %e \n",abs(aAvgErr/aj),abs(bAvgErr/bj),abs(cAvgErr/cj));
+	printf ("Results Validation Verbose Results: \n");
+	printf ("    Expected a(1), b(1), c(1): %f %f %f \n",aj,bj,cj);
+	printf ("    Observed a(1), b(1), c(1): %f %f %f \n",a[1],b[1],c[1]);
+	printf ("    Rel Errors on a, b, c:     %e %e %e \n",abs(aAvgErr/aj),abs(bAvgErr/bj),abs(cAvgErr/cj));
 #endif
+	return err;
 }
 
 #ifdef TUNED
@@ -527,7 +1644,7 @@ void tuned_STREAM_Copy()
 {
 	ssize_t j;
 #pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	for (j=0; j<array_size; j++)
 		c[j] = a[j];
 }
 
@@ -535,7 +1652,7 @@ void tuned_STREAM_Scale(STREAM_TYPE scalar)
 {
 	ssize_t j;
 #pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	for (j=0; j<array_size; j++)
 		b[j] = scalar*c[j];
 }
 
@@ -543,7 +1660,7 @@ void tuned_STREAM_Add()
 {
 	ssize_t j;
 #pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	for (j=0; j<array_size; j++)
 		c[j] = a[j]+b[j];
 }
 
@@ -551,7 +1668,7 @@ void tuned_STREAM_Triad(STREAM_TYPE scalar)
 {
 	ssize_t j;
 #pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	for (j=0; j<array_size; j++)
 		a[j] = b[j]+scalar*c[j];
 }
 /* end of stubs for the "tuned" versions of the kernels */
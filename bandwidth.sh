@@ -1,6 +1,7 @@
-./bandwidth 1
-for (( i=4;i<=$1;i=i+4))
-do
-./bandwidth $i
-done
-./bandwidth 255
+# all thread counts in one process, the arrays are allocated and initialized once
+# 4 to $1 in steps of 4 only if there are any, like the old loop
+if [ "$1" -ge 4 ]; then
+./phibench "bandwidth threads=1,4-$1:4,255"
+else
+./phibench "bandwidth threads=1,255"
+fi
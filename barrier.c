@@ -0,0 +1,119 @@
+/********************************************************************
+ * Barriers for the threads around the timed regions
+ * See barrier.h for the kinds.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <immintrin.h>
+#include "barrier.h"
+
+#define SPINS_BEFORE_YIELD (1<<14)					//in case two threads share a CPU after all
+
+static const char *names[BARRIER_KINDS]={"pthread", "sense", "dissemination"};
+
+const char *barrier_name(int kind)
+{
+	return kind>=0 && kind<BARRIER_KINDS ? names[kind] : "unknown";
+}
+
+int barrier_default(void)
+{
+	const char *env=getenv("PHI_BARRIER");
+	int k;
+
+	if (env==NULL)
+		return BARRIER_SENSE;
+	for (k=0;k<BARRIER_KINDS;++k)
+		if (strcmp(env, names[k])==0)
+			return k;
+	fprintf(stderr, "PHI_BARRIER: unknown barrier \"%s\", using sense\n", env);
+	return BARRIER_SENSE;
+}
+
+/* one iteration of a spin loop, every SPINS_BEFORE_YIELD the CPU is given up */
+static inline void spin(long *spins)
+{
+#ifdef __MIC__
+	_mm_delay_32(16);
+#else
+	_mm_pause();
+#endif
+	if (++*spins%SPINS_BEFORE_YIELD==0)
+		sched_yield();
+}
+
+int barrier_init(barrier_t *b, int threads, int kind)
+{
+	int r;
+
+	memset(b, 0, sizeof(*b));
+	b->kind = kind<0 ? barrier_default() : kind;
+	b->threads=threads;
+	for (b->rounds=0;(1<<b->rounds)<threads;++b->rounds);
+	if (threads<1 || threads>BARRIER_MAX_THREADS)
+		return -1;
+	if (b->kind==BARRIER_PTHREAD)
+		return pthread_barrier_init(&b->pthread, NULL, threads)==0 ? 0 : -1;
+	if (posix_memalign((void **) &b->local, 64, threads*sizeof(barrier_thread_t))!=0)
+		return -1;
+	memset(b->local, 0, threads*sizeof(barrier_thread_t));
+	for (r=0;r<threads && b->kind==BARRIER_DISSEMINATION;++r)
+		b->local[r].sense=1;								//the flags start at 0
+	b->count=threads;
+	return 0;
+}
+
+void barrier_wait(barrier_t *b, int tid)
+{
+	barrier_thread_t *me;
+	long spins=0;
+	int r;
+
+	if (b->kind==BARRIER_PTHREAD)
+	{
+		pthread_barrier_wait(&b->pthread);
+		return;
+	}
+	me=&b->local[tid];
+	if (b->kind==BARRIER_SENSE)
+	{
+		//the last thread to arrive resets the count and flips the sense for all
+		me->sense=!me->sense;
+		if (__sync_fetch_and_sub(&b->count, 1)==1)
+		{
+			b->count=b->threads;
+			__sync_synchronize();
+			b->sense=me->sense;
+		}
+		else
+			while (b->sense!=me->sense)
+				spin(&spins);
+		return;
+	}
+	//dissemination: in round r, signal thread tid+2^r and wait for thread tid-2^r
+	for (r=0;r<b->rounds;++r)
+	{
+		b->local[(tid+(1<<r))%b->threads].flag[me->parity][r]=me->sense;
+		while (me->flag[me->parity][r]!=me->sense)
+			spin(&spins);
+	}
+	//the flags of a parity are used every other episode, the sense flips after both
+	if (me->parity==1)
+		me->sense=!me->sense;
+	me->parity=1-me->parity;
+}
+
+void barrier_destroy(barrier_t *b)
+{
+	if (b->kind==BARRIER_PTHREAD)
+		pthread_barrier_destroy(&b->pthread);
+	free(b->local);
+	b->local=NULL;
+}
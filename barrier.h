@@ -0,0 +1,63 @@
+/********************************************************************
+ * Barriers for the threads around the timed regions
+ *
+ * The kind is selected with the environment variable PHI_BARRIER:
+ *   pthread       - pthread_barrier_t, sleeps in the kernel (futex)
+ *   sense         - a spinning, sense-reversing central counter
+ *   dissemination - a spinning dissemination barrier, log2(threads)
+ *                   rounds of flags written to a partner thread
+ * Without PHI_BARRIER the default is sense. The spinning barriers let
+ * the threads leave within a few hundred cycles of each other, where
+ * the futex wakes them one by one; they expect every thread on its own
+ * CPU and yield only after a long spin.
+ *******************************************************************/
+
+#ifndef PHI_BARRIER_H
+#define PHI_BARRIER_H
+
+#include <pthread.h>
+
+#define BARRIER_MAX_THREADS 512
+#define BARRIER_MAX_ROUNDS 9							//log2(BARRIER_MAX_THREADS)
+
+enum {BARRIER_PTHREAD, BARRIER_SENSE, BARRIER_DISSEMINATION, BARRIER_KINDS};
+
+/*!@brief The state of one thread, one cache line of its own */
+typedef struct
+{
+	volatile int flag[2][BARRIER_MAX_ROUNDS];		/**< dissemination flags, written by the partners */
+	int parity;
+	int sense;
+}__attribute__((aligned(64))) barrier_thread_t;
+
+/*!@brief A barrier for a fixed number of threads with ids 0..threads-1 */
+typedef struct
+{
+	int kind;
+	int threads;
+	int rounds;										/**< of the dissemination barrier */
+	pthread_barrier_t pthread;
+	volatile int count __attribute__((aligned(64)));
+	volatile int sense __attribute__((aligned(64)));
+	barrier_thread_t *local;						/**< threads entries */
+}barrier_t;
+
+/*!@brief Initializes a barrier for threads threads.
+ * @param kind BARRIER_PTHREAD, ..., or -1 for the kind of PHI_BARRIER
+ * @return 0, or -1 if the barrier cannot be allocated
+ */
+int barrier_init(barrier_t *b, int threads, int kind);
+
+/*!@brief Waits until all threads have arrived; tid is the id of the calling thread. */
+void barrier_wait(barrier_t *b, int tid);
+
+/*!@brief Frees the barrier, no thread may wait in it. */
+void barrier_destroy(barrier_t *b);
+
+/*!@brief Name of a kind, e.g. "sense". */
+const char *barrier_name(int kind);
+
+/*!@brief The kind selected by PHI_BARRIER. */
+int barrier_default(void);
+
+#endif
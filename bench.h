@@ -0,0 +1,60 @@
+/********************************************************************
+ * Entry points of the benchmarks for the in-process driver (driver.c)
+ *
+ * bandwidth.c and fmadd.c are linked into the driver with -DPHI_DRIVER,
+ * which leaves out their main(). The driver calls bi_timer_init(),
+ * placement_init() and mem_init() once and switches the placement and
+ * the memory kinds between points with placement_set() and
+ * mem_set_kinds().
+ *******************************************************************/
+
+#ifndef PHI_BENCH_H
+#define PHI_BENCH_H
+
+#include <stddef.h>
+
+/*!@brief Allocates the bandwidth arrays of the given bytes each where PHI_MEMORY
+ *        (or mem_set_kinds()) puts them, and first touches them with the
+ *        given number of threads pinned by the current placement. The
+ *        pages stay on the NUMA nodes of those threads, so after a change
+ *        of the placement the arrays have to be set up again.
+ * @param kernels The kernels of the following points, as for bandwidth.
+ * @return 0 on success, -1 if the kernels are unknown or the arrays
+ *         cannot be allocated.
+ */
+int bandwidth_setup(size_t bytes, const char *kernels, int threads);
+
+/*!@brief Frees the arrays of bandwidth_setup(). */
+void bandwidth_teardown(void);
+
+/*!@brief Creates the worker pool of the following points, the threads are
+ *        pinned by the current placement.
+ * @return 0 on success, -1 if threads is out of range.
+ */
+int bandwidth_start(int threads);
+
+/*!@brief Ends the worker pool of bandwidth_start(). */
+void bandwidth_stop(void);
+
+/*!@brief Sets the software prefetch distances of the following points.
+ * @param spec As for PHI_PREFETCH: "off" (or NULL), "<L1 lines>:<L2 lines>",
+ *        comma separated lists of both, or "sweep". With several pairs every
+ *        point measures all of them and prints the best pair per kernel.
+ * @return 0, or -1 if spec cannot be parsed (prefetching is off then).
+ */
+int bandwidth_prefetch(const char *spec);
+
+/*!@brief Runs the kernels of bandwidth_setup() on the first bytes of every
+ *        array and prints a line per kernel, like the sweep mode. Small
+ *        sizes are repeated within the timed region as in the sweep mode.
+ * @return 0 on success, -1 if the size does not fit the arrays or the pool.
+ */
+int bandwidth_run(size_t bytes);
+
+/*!@brief Runs the fmadd kernel of the given precision on threads threads
+ *        and prints a line like fmadd; the ISA is printed when it changes.
+ * @return 0 on success, -1 if there is no such kernel on this CPU.
+ */
+int fmadd_run(int threads, const char *precision);
+
+#endif
@@ -0,0 +1,107 @@
+/********************************************************************
+ * Cold caches
+ * See cache.h for the flushes.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "cache.h"
+
+#define LINE 64
+#define PAGE 4096
+
+int bi_cold=0;
+
+static char *tlb_pages;								//CACHE_TLB_PAGES small pages
+static pthread_once_t tlb_once=PTHREAD_ONCE_INIT;
+
+int bi_cache_args(int argc, char **argv)
+{
+	int i, n=1;
+	for (i=1;i<argc;++i)
+		if (strcmp(argv[i], "--cold")==0)
+			bi_cold=1;
+		else
+			argv[n++]=argv[i];
+	argv[n]=NULL;
+	return n;
+}
+
+const char *bi_cache_name(void)
+{
+	return bi_cold ? "cold" : "warm";
+}
+
+void bi_flushRegion(const void *p, size_t bytes)
+{
+	const char *line=(const char *) ((uintptr_t) p & ~(uintptr_t) (LINE-1));
+	const char *end=(const char *) p+bytes;
+
+	for (;line<end;line+=LINE)
+		__asm__ __volatile__ ("clflush %0" : : "m" (*line));
+	__asm__ __volatile__ ("mfence" : : : "memory");
+}
+
+/* the pages are small ones of their own, written once, so every touch needs a TLB entry */
+static void tlb_init(void)
+{
+	void *p=mmap(NULL, (size_t) CACHE_TLB_PAGES*PAGE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p==MAP_FAILED)
+	{
+		fprintf(stderr, "Cannot map the pages to flush the TLB\n");
+		return;
+	}
+#ifdef MADV_NOHUGEPAGE
+	madvise(p, (size_t) CACHE_TLB_PAGES*PAGE, MADV_NOHUGEPAGE);
+#endif
+	memset(p, 1, (size_t) CACHE_TLB_PAGES*PAGE);
+	tlb_pages=(char *) p;
+}
+
+void bi_flushTLB(void)
+{
+	volatile char *page;
+	long i;
+
+	pthread_once(&tlb_once, tlb_init);
+	if (tlb_pages==NULL)
+		return;
+	//a different line in every page, so the touches do not pile up in one cache set
+	for (i=0;i<CACHE_TLB_PAGES;++i)
+	{
+		page=tlb_pages+i*PAGE+(i%(PAGE/LINE))*LINE;
+		(void) *page;
+	}
+}
+
+int bi_confuseCache(size_t nCacheSize)
+{
+	static int *buffer;
+	static size_t size;
+	size_t i, n=nCacheSize/sizeof(int);
+	int sum=0;
+
+	if (nCacheSize>size)
+	{
+		free(buffer);
+		if ((buffer=(int *) malloc(nCacheSize))==NULL)
+		{
+			size=0;
+			return 0;
+		}
+		size=nCacheSize;
+	}
+	for (i=0;i<n;++i)
+		buffer[i]=(int) i;
+	for (i=0;i<n;++i)
+		sum+=buffer[i];
+	return sum;
+}
@@ -0,0 +1,37 @@
+/********************************************************************
+ * Cold caches for latency.c and bandwidth.c
+ *
+ * Implements bi_confuseCache() of interface.h, and the flushes of the
+ * "--cold" runs: before every timed repetition the buffers are evicted
+ * from all cache levels with clflush, and the data TLB of the calling
+ * CPU is emptied by touching one line in each of CACHE_TLB_PAGES 4 KB
+ * pages of a buffer of its own. Without --cold the benchmarks run warm,
+ * after a pre-run.
+ *******************************************************************/
+
+#ifndef PHI_CACHE_H
+#define PHI_CACHE_H
+
+#include <stddef.h>
+#include "interface.h"
+
+#define CACHE_TLB_PAGES 8192							//more than the entries of the second level DTLB
+
+/*!@brief Nonzero for cold runs. */
+extern int bi_cold;
+
+/*!@brief Removes "--cold" from the arguments and sets bi_cold.
+ * @return The number of the remaining arguments.
+ */
+int bi_cache_args(int argc, char **argv);
+
+/*!@brief "cold" or "warm", the label of the results. */
+const char *bi_cache_name(void);
+
+/*!@brief Evicts [p, p+bytes) from all caches. */
+void bi_flushRegion(const void *p, size_t bytes);
+
+/*!@brief Evicts the entries of the data TLB of the calling CPU. */
+void bi_flushTLB(void);
+
+#endif
@@ -0,0 +1,248 @@
+/********************************************************************
+ * Hardware performance counters
+ * See counters.h for the description of the events.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "counters.h"
+
+#ifndef SYSFS_PMU
+#define SYSFS_PMU "/sys/bus/event_source/devices"
+#endif
+
+typedef struct
+{
+	char name[64];
+	uint32_t type;
+	uint64_t config;
+	int core;						//counts the calling thread, otherwise the whole PMU of its CPU
+	int failed;						//reported once
+	int multiplexed;				//reported once
+}event_t;
+
+static event_t events[CNT_MAX_EVENTS];
+static int nevents;
+
+#define CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+}named[]={
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"ref-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES},
+	{"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+	{"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{"l1d-misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+	{"llc-misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+	{"dtlb-misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+	{"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+	{"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+	{NULL, 0, 0}
+};
+
+/* the perf type of a PMU from sysfs, -1 if there is no such PMU */
+static long pmu_type(const char *pmu)
+{
+	char path[256];
+	long type=-1;
+	FILE *f;
+	snprintf(path, sizeof(path), "%s/%s/type", SYSFS_PMU, pmu);
+	if ((f=fopen(path, "r"))==NULL)
+		return -1;
+	if (fscanf(f, "%ld", &type)!=1)
+		type=-1;
+	fclose(f);
+	return type;
+}
+
+/* parses one event of PHI_COUNTERS into e, returns 0 or -1 */
+static int parse_event(const char *name, event_t *e)
+{
+	const char *colon=strchr(name, ':');
+	char *end;
+	int i;
+	snprintf(e->name, sizeof(e->name), "%s", name);
+	e->core=1;
+	e->failed=0;
+	for (i=0;named[i].name!=NULL;++i)
+		if (strcmp(name, named[i].name)==0)
+		{
+			e->type=named[i].type;
+			e->config=named[i].config;
+			return 0;
+		}
+	if (name[0]=='r' && colon==NULL)
+	{
+		e->type=PERF_TYPE_RAW;
+		e->config=strtoull(name+1, &end, 16);
+		return end==name+1 || *end ? -1 : 0;
+	}
+	if (colon!=NULL)
+	{
+		char pmu[64];
+		long type;
+		snprintf(pmu, sizeof(pmu), "%.*s", (int) (colon-name), name);
+		if ((type=pmu_type(pmu))<0)
+			return -1;
+		e->type=(uint32_t) type;
+		e->config=strtoull(colon+1, &end, 16);
+		e->core=0;
+		return end==colon+1 || *end ? -1 : 0;
+	}
+	return -1;
+}
+
+void cnt_init(void)
+{
+	const char *env=getenv("PHI_COUNTERS");
+	char buf[512], *name, *save=NULL;
+
+	nevents=0;
+	if (env==NULL)
+		return;
+	snprintf(buf, sizeof(buf), "%s", env);
+	for (name=strtok_r(buf, ",", &save); name!=NULL; name=strtok_r(NULL, ",", &save))
+	{
+		if (nevents==CNT_MAX_EVENTS)
+		{
+			fprintf(stderr, "PHI_COUNTERS: at most %d events, ignoring \"%s\"\n", CNT_MAX_EVENTS, name);
+			break;
+		}
+		if (parse_event(name, &events[nevents])!=0)
+			fprintf(stderr, "PHI_COUNTERS: unknown event \"%s\"\n", name);
+		else
+			nevents++;
+	}
+}
+
+int cnt_events(void)
+{
+	return nevents;
+}
+
+void cnt_open(cnt_t *cnt)
+{
+	cnt_open_thread(cnt, 0);
+}
+
+void cnt_open_thread(cnt_t *cnt, int tid)
+{
+	struct perf_event_attr attr;
+	int i;
+
+	for (i=0;i<nevents;++i)
+	{
+		cnt->value[i]=0;
+		cnt->fd[i]=-1;
+		if (!events[i].core && tid!=0)
+			continue;					//other PMUs count the whole package, once is enough
+		memset(&attr, 0, sizeof(attr));
+		attr.size=sizeof(attr);
+		attr.type=events[i].type;
+		attr.config=events[i].config;
+		attr.disabled=1;
+		attr.read_format=PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel=events[i].core;
+		attr.exclude_hv=events[i].core;
+		//core events follow the calling thread, other PMUs count on the CPU it is pinned to
+		if (events[i].core)
+			cnt->fd[i]=(int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		else
+			cnt->fd[i]=(int) syscall(__NR_perf_event_open, &attr, -1, sched_getcpu(), -1, 0);
+		if (cnt->fd[i]<0 && !events[i].failed)
+		{
+			events[i].failed=1;
+			fprintf(stderr, "PHI_COUNTERS: cannot open %s: %s\n", events[i].name, strerror(errno));
+		}
+	}
+}
+
+void cnt_close(cnt_t *cnt)
+{
+	int i;
+	for (i=0;i<nevents;++i)
+		if (cnt->fd[i]>=0)
+			close(cnt->fd[i]);
+}
+
+void cnt_start(cnt_t *cnt)
+{
+	int i;
+	for (i=0;i<nevents;++i)
+		if (cnt->fd[i]>=0)
+		{
+			ioctl(cnt->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(cnt->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+}
+
+void cnt_stop(cnt_t *cnt)
+{
+	uint64_t v[3];					//count, time enabled, time running
+	int i;
+	for (i=0;i<nevents;++i)
+		if (cnt->fd[i]>=0)
+			ioctl(cnt->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	for (i=0;i<nevents;++i)
+	{
+		cnt->value[i]=0;
+		if (cnt->fd[i]<0 || read(cnt->fd[i], v, sizeof(v))!=sizeof(v) || v[1]==0)
+			continue;
+		if (v[2]==0)
+		{
+			//never on a counter, e.g. more events than counters: left out like an event that cannot be opened
+			if (!events[i].failed)
+				fprintf(stderr, "PHI_COUNTERS: %s did not get a counter, leaving it out\n", events[i].name);
+			events[i].failed=1;
+			continue;
+		}
+		if (v[2]<v[1] && !events[i].multiplexed)
+		{
+			events[i].multiplexed=1;
+			fprintf(stderr, "PHI_COUNTERS: %s shares a counter with other events, its counts are scaled up\n", events[i].name);
+		}
+		//the count while the event was on a counter, scaled to the whole region
+		cnt->value[i]=(uint64_t) ((double) v[0]*v[1]/v[2]+0.5);
+	}
+}
+
+void cnt_add(double *sum, const cnt_t *cnt)
+{
+	int i;
+	for (i=0;i<nevents;++i)
+		sum[i]+=(double) cnt->value[i];
+}
+
+void cnt_print(const double *sum, double per, const char *unit)
+{
+	int i;
+	for (i=0;i<nevents;++i)
+		if (!events[i].failed)
+			printf("\t%s per %s:\t%f", events[i].name, unit, sum[i]/per);
+}
+
+void cnt_params(char *buf, size_t size, const double *sum, double per, const char *unit)
+{
+	size_t len=strlen(buf);
+	int i;
+	for (i=0;i<nevents && len<size;++i)
+		if (!events[i].failed)
+			len+=snprintf(buf+len, size-len, ";%s/%s=%g", events[i].name, unit, sum[i]/per);
+}
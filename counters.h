@@ -0,0 +1,79 @@
+/********************************************************************
+ * Hardware performance counters around the timed regions
+ *
+ * The events are selected with the environment variable PHI_COUNTERS,
+ * a comma separated list of at most CNT_MAX_EVENTS of
+ *   cycles, instructions, ref-cycles, branch-misses,
+ *   cache-references, cache-misses - the generic perf events
+ *   l1d-misses, llc-misses, dtlb-misses - L1D, last level cache (L2 on
+ *                 KNL) and DTLB read misses
+ *   task-clock, page-faults - software events, nanoseconds on the CPU
+ *                 and page faults
+ *   r<hex>      - a raw event of the core PMU, e.g. r412e
+ *   <pmu>:<hex> - an event of another PMU in /sys/bus/event_source,
+ *                 e.g. an uncore or MCDRAM (EDC) event; it counts the
+ *                 whole PMU, not just the thread
+ * Every pinned thread opens its own events with perf_event_open() and
+ * counts only user space (except for other PMUs). The benchmarks print
+ * the counts normalized per jump, per byte or per FLOP. Events that
+ * cannot be opened (e.g. perf_event_paranoid too high) are reported
+ * once and left out. The threads of one measurement open the events of
+ * other PMUs only once (cnt_open_thread()), in thread 0, so their sum
+ * over the threads is the count of the package of thread 0, not that
+ * count times the threads. With more events than counters (two general
+ * purpose counters per thread on KNL) the kernel multiplexes them; the
+ * counts are then scaled by the time enabled over the time running,
+ * which is reported once, and events that never ran are left out.
+ *******************************************************************/
+
+#ifndef PHI_COUNTERS_H
+#define PHI_COUNTERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CNT_MAX_EVENTS 8
+
+/*!@brief The events of one thread */
+typedef struct
+{
+	int fd[CNT_MAX_EVENTS];			/**< -1 if the event could not be opened */
+	uint64_t value[CNT_MAX_EVENTS];	/**< the counts of the last cnt_start()/cnt_stop() */
+}cnt_t;
+
+/*!@brief Reads PHI_COUNTERS. Has to be called once in main(). */
+void cnt_init(void);
+
+/*!@brief Number of selected events, 0 without PHI_COUNTERS. */
+int cnt_events(void);
+
+/*!@brief Opens the events for the calling thread, which should be pinned already. */
+void cnt_open(cnt_t *cnt);
+
+/*!@brief Like cnt_open() for thread tid of threads whose counts are summed
+ *        up: the events of other PMUs count the whole package, so only
+ *        thread 0 opens them and the others count 0 for them.
+ */
+void cnt_open_thread(cnt_t *cnt, int tid);
+
+/*!@brief Closes the events of cnt_open(). */
+void cnt_close(cnt_t *cnt);
+
+/*!@brief Resets and starts the events. */
+void cnt_start(cnt_t *cnt);
+
+/*!@brief Stops the events and stores their counts in cnt->value. */
+void cnt_stop(cnt_t *cnt);
+
+/*!@brief Adds the counts of cnt to sum[0..cnt_events()). */
+void cnt_add(double *sum, const cnt_t *cnt);
+
+/*!@brief Prints "\t<event> per <unit>:\t<sum/per>" for every event. */
+void cnt_print(const double *sum, double per, const char *unit);
+
+/*!@brief Appends ";<event>/<unit>=<sum/per>" for every event to buf, for
+ *        the params of a result record.
+ */
+void cnt_params(char *buf, size_t size, const double *sum, double per, const char *unit);
+
+#endif
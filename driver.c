@@ -0,0 +1,348 @@
+/********************************************************************
+ * In-process benchmark driver
+ *
+ * Runs whole sweeps of bandwidth and fmadd in one process instead of one
+ * process per point, as bandwidth.sh and fmadd.sh used to do. Every line
+ * of the spec is one benchmark and the values it is swept over:
+ *
+ *   bandwidth threads=1,4-max:4,255 size=512M kernels=copy,scale,add,triad
+ *   bandwidth threads=64 size=4K-1G kernels=read,copy memory=ddr memory=hbw
+ *   fmadd threads=4-max:4 precision=single precision=double placement=compact
+ *
+ *   threads=<list>   numbers and ranges lo-hi[:step], "max" is the length
+ *                    of the placement list (the default)
+ *   size=<list>      bytes per array with an optional K, M or G, ranges
+ *                    lo-hi go in powers of two (bandwidth, default 512M)
+ *   kernels=<list>   as for bandwidth (default copy,scale,add,triad)
+ *   precision=<p>    single or double (fmadd, default single)
+ *   placement=<p>    a policy as for PHI_PLACEMENT (default PHI_PLACEMENT)
+ *   memory=<m>       kinds as for PHI_MEMORY (bandwidth, default PHI_MEMORY)
+ *   cache=<c>        warm, or cold to flush the arrays before every timed
+ *                    run as bandwidth --cold does (bandwidth, default warm)
+ *   prefetch=<p>     software prefetch distances as for PHI_PREFETCH, the
+ *                    best pair is printed per thread count and size
+ *                    (bandwidth, default PHI_PREFETCH)
+ * placement, memory and precision are swept by giving them several times.
+ * The bandwidth arrays are allocated and first touched once per memory
+ * setting and placement at the largest size, by the largest thread count
+ * of the placement, so with NUMA (e.g. SNC modes) the pages of every
+ * placement are spread over its own threads; a worker pool is created
+ * once per thread count and runs all sizes. Lines starting with # are comments.
+ *
+ * Usage: phibench <spec file> | - (the spec on stdin) | <spec lines...>
+ * where every line given as an argument has to be quoted.
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timer.h"
+#include "placement.h"
+#include "memory.h"
+#include "bench.h"
+#include "result.h"
+#include "counters.h"
+#include "cache.h"
+#include "adapt.h"
+#include "power.h"
+
+#define MAX_LINES 64					//lines of a spec
+#define MAX_VALUES 256					//values of one key in a line
+
+typedef struct
+{
+	char text[1024];					//the line, split into the strings below
+	const char *bench;
+	const char *threads;
+	const char *sizes;
+	const char *kernels;
+	const char *cache;
+	const char *prefetch;
+	const char *placement[MAX_VALUES];
+	const char *memory[MAX_VALUES];
+	const char *precision[MAX_VALUES];
+	int nplacement, nmemory, nprecision;
+}spec_t;
+
+static spec_t spec[MAX_LINES];
+static int nspec;
+static char default_placement[256];
+
+/* parses a number of bytes with an optional K, M or G suffix, 0 on error */
+static size_t parse_bytes(const char *str, const char **end)
+{
+	char *e;
+	size_t n=strtoul(str, &e, 10);
+	if (*e=='K' || *e=='k')
+		n<<=10, ++e;
+	else if (*e=='M' || *e=='m')
+		n<<=20, ++e;
+	else if (*e=='G' || *e=='g')
+		n<<=30, ++e;
+	*end=e;
+	return e==str ? 0 : n;
+}
+/* parses a thread count, "max" for the length of the placement list */
+static int parse_count(char *str, int max, char **end)
+{
+	if (strncmp(str, "max", 3)==0)
+	{
+		*end=str+3;
+		return max;
+	}
+	return (int) strtol(str, end, 10);
+}
+/* expands a list of thread counts with ranges lo-hi[:step] and "max"; returns the number of values or -1 */
+static int parse_threads(const char *list, int max, int *out)
+{
+	char buf[256], *item, *save=NULL, *e;
+	int n=0, lo, hi, step;
+	strncpy(buf, list, sizeof(buf)-1);
+	buf[sizeof(buf)-1]='\0';
+	for (item=strtok_r(buf, ",", &save); item!=NULL; item=strtok_r(NULL, ",", &save))
+	{
+		lo=hi=parse_count(item, max, &e);
+		step=1;
+		if (*e=='-')
+		{
+			item=e+1;
+			hi=parse_count(item, max, &e);
+			if (*e==':')
+				step=(int) strtol(e+1, &e, 10);
+		}
+		if (e==item || *e!='\0' || lo<1 || hi<lo || step<1)
+			return -1;
+		for (;lo<=hi && n<MAX_VALUES;lo+=step)
+			out[n++]=lo;
+	}
+	return n;
+}
+/* expands a list of sizes, ranges lo-hi in powers of two; returns the number of values or -1 */
+static int parse_sizes(const char *list, size_t *out)
+{
+	char buf[256], *item, *save=NULL;
+	const char *e;
+	size_t lo, hi;
+	int n=0;
+	strncpy(buf, list, sizeof(buf)-1);
+	buf[sizeof(buf)-1]='\0';
+	for (item=strtok_r(buf, ",", &save); item!=NULL; item=strtok_r(NULL, ",", &save))
+	{
+		lo=hi=parse_bytes(item, &e);
+		if (*e=='-')
+			hi=parse_bytes(e+1, &e);
+		if (lo==0 || hi<lo || *e!='\0')
+			return -1;
+		for (;lo<=hi && n<MAX_VALUES;lo*=2)
+			out[n++]=lo;
+	}
+	return n;
+}
+
+/* splits one line of the spec into spec[nspec]; returns 0 for a benchmark line, 1 for a comment, -1 on errors */
+static int parse_line(const char *line)
+{
+	spec_t *s=&spec[nspec];
+	char *tok, *save=NULL, *eq;
+	memset(s, 0, sizeof(*s));
+	snprintf(s->text, sizeof(s->text), "%s", line);
+	tok=strtok_r(s->text, " \t\r\n", &save);
+	if (tok==NULL || tok[0]=='#')
+		return 1;
+	s->bench=tok;
+	if (strcmp(s->bench, "bandwidth")!=0 && strcmp(s->bench, "fmadd")!=0)
+	{
+		printf("Unknown benchmark \"%s\", only bandwidth and fmadd run in the driver\n", s->bench);
+		return -1;
+	}
+	s->threads="max";
+	s->sizes="512M";
+	s->kernels="copy,scale,add,triad";
+	s->cache="warm";
+	s->prefetch=getenv("PHI_PREFETCH");					//may be NULL, no prefetching
+	while ((tok=strtok_r(NULL, " \t\r\n", &save))!=NULL)
+	{
+		eq=strchr(tok, '=');
+		if (eq==NULL)
+		{
+			printf("Expected key=value instead of \"%s\"\n", tok);
+			return -1;
+		}
+		*eq++='\0';
+		if (strcmp(tok, "threads")==0)
+			s->threads=eq;
+		else if (strcmp(tok, "size")==0)
+			s->sizes=eq;
+		else if (strcmp(tok, "kernels")==0)
+			s->kernels=eq;
+		else if (strcmp(tok, "cache")==0)
+		{
+			if (strcmp(eq, "warm")!=0 && strcmp(eq, "cold")!=0)
+			{
+				printf("Expected cache=warm or cache=cold\n");
+				return -1;
+			}
+			s->cache=eq;
+		}
+		else if (strcmp(tok, "prefetch")==0)
+			s->prefetch=eq;
+		else if (strcmp(tok, "placement")==0 && s->nplacement<MAX_VALUES)
+			s->placement[s->nplacement++]=eq;
+		else if (strcmp(tok, "memory")==0 && s->nmemory<MAX_VALUES)
+			s->memory[s->nmemory++]=eq;
+		else if (strcmp(tok, "precision")==0 && s->nprecision<MAX_VALUES)
+			s->precision[s->nprecision++]=eq;
+		else
+		{
+			printf("Unknown key \"%s\"\n", tok);
+			return -1;
+		}
+	}
+	if (s->nplacement==0)
+		s->placement[s->nplacement++]=default_placement;
+	if (s->nmemory==0)
+		s->memory[s->nmemory++]=getenv("PHI_MEMORY");			//may be NULL, the defaults of memory.c
+	if (s->nprecision==0)
+		s->precision[s->nprecision++]="single";
+	return 0;
+}
+
+/* checks the thread counts of a line for all of its placements; returns 0 or -1 */
+static int check_threads(spec_t *s)
+{
+	int t[MAX_VALUES], p;
+	for (p=0;p<s->nplacement;++p)
+		if (placement_set(s->placement[p])==0 || parse_threads(s->threads, placement_count(), t)<1)
+		{
+			printf("Invalid threads \"%s\" or placement \"%s\"\n", s->threads, s->placement[p]);
+			return -1;
+		}
+	return 0;
+}
+/* the largest of n values */
+static size_t largest(const size_t *v, int n)
+{
+	size_t max=0;
+	int i;
+	for (i=0;i<n;++i)
+		if (v[i]>max)
+			max=v[i];
+	return max;
+}
+
+static int run_bandwidth(spec_t *s)
+{
+	int t[MAX_VALUES], nt, p, m, i, j, ns, first, err=0;
+	size_t sizes[MAX_VALUES];
+
+	if ((ns=parse_sizes(s->sizes, sizes))<1)
+	{
+		printf("Invalid sizes \"%s\"\n", s->sizes);
+		return -1;
+	}
+	bi_cold=strcmp(s->cache, "cold")==0;
+	if (bandwidth_prefetch(s->prefetch)!=0)
+		return -1;
+	for (m=0;m<s->nmemory;++m)
+		for (p=0;p<s->nplacement;++p)
+		{
+			//one allocation and first touch at the largest size for all points of this memory
+			//setting and placement, so the pages are local to the threads of the placement
+			mem_set_kinds(s->memory[m]);
+			placement_set(s->placement[p]);
+			nt=parse_threads(s->threads, placement_count(), t);
+			for (first=t[0], i=1;i<nt;++i)
+				if (t[i]>first)
+					first=t[i];
+			if (bandwidth_setup(largest(sizes, ns), s->kernels, first)!=0)
+				return -1;
+			printf("Benchmark:\tbandwidth\tPlacement:\t%s\n", placement_name());
+			for (i=0;i<nt;++i)
+			{
+				if (bandwidth_start(t[i])!=0)
+				{
+					err=-1;
+					continue;
+				}
+				for (j=0;j<ns;++j)
+					if (bandwidth_run(sizes[j])!=0)
+						err=-1;
+				bandwidth_stop();
+			}
+			bandwidth_teardown();
+		}
+	return err;
+}
+
+static int run_fmadd(spec_t *s)
+{
+	int t[MAX_VALUES], nt, p, k, i, err=0;
+
+	for (p=0;p<s->nplacement;++p)
+	{
+		placement_set(s->placement[p]);
+		nt=parse_threads(s->threads, placement_count(), t);
+		printf("Benchmark:\tfmadd\tPlacement:\t%s\n", placement_name());
+		for (k=0;k<s->nprecision;++k)
+			for (i=0;i<nt;++i)
+				if (fmadd_run(t[i], s->precision[k])!=0)
+					err=-1;
+	}
+	return err;
+}
+
+int main (int argc, char **argv)
+{
+	char line[1024];
+	FILE *file=NULL;
+	int i, r, err=0;
+
+	if (argc<2)
+	{
+		printf("Usage: %s <spec file> | - | <spec lines...>\n", argv[0]);
+		return 1;
+	}
+	bi_timer_init();
+	placement_init();
+	mem_init();
+	result_init();
+	cnt_init();
+	adapt_init();
+	pwr_init();
+	strncpy(default_placement, placement_name(), sizeof(default_placement)-1);
+
+	//the whole spec is checked before anything runs
+	//a single argument is a spec file if there is one, otherwise every argument is a line
+	if (argc==2 && strcmp(argv[1], "-")==0)
+		file=stdin;
+	else if (argc==2)
+		file=fopen(argv[1], "r");
+	for (i=1;;++i)
+	{
+		if (file!=NULL ? fgets(line, sizeof(line), file)==NULL : i>=argc)
+			break;
+		if (nspec==MAX_LINES)
+		{
+			printf("At most %d lines in a spec\n", MAX_LINES);
+			return 1;
+		}
+		r=parse_line(file!=NULL ? line : argv[i]);
+		if (r<0 || (r==0 && check_threads(&spec[nspec])<0))
+			return 1;
+		if (r==0)
+			nspec++;
+	}
+	if (file!=NULL && file!=stdin)
+		fclose(file);
+
+	for (i=0;i<nspec;++i)
+	{
+		if (strcmp(spec[i].bench, "bandwidth")==0)
+			r=run_bandwidth(&spec[i]);
+		else
+			r=run_fmadd(&spec[i]);
+		if (r!=0)
+			err=1;
+	}
+	return err;
+}
@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -9,121 +10,393 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
-#include "immintrin.h"
-#ifndef DOUBLE
-#define ONE {a=_mm512_fmadd_ps(a,b,c);b=_mm512_fmadd_ps(a,b,c);c=_mm512_fmadd_ps(a,b,c);}
-#else
-#define ONE {a=_mm512_fmadd_pd(a,b,c);b=_mm512_fmadd_pd(a,b,c);c=_mm512_fmadd_pd(a,b,c);}
-#endif
-#define TEN ONE ONE ONE ONE ONE ONE ONE ONE ONE ONE
-#define HUN TEN TEN TEN TEN TEN TEN TEN TEN TEN TEN
-#define THO HUN HUN HUN HUN HUN HUN HUN HUN HUN HUN
+#include "timer.h"
+#include "placement.h"
+#include "fmadd.h"
+#include "bench.h"
+#include "result.h"
+#include "counters.h"
+#include "barrier.h"
+#include "adapt.h"
+#include "power.h"
 
-double d_bi_start_sec; /**< start time */
-static double bi_gettimeofday() {
-	struct timeval time;
-	gettimeofday(&time, (struct timezone *) 0);
-	return (double) time.tv_sec + (double) time.tv_usec * 1.0e-6;
-}
-static double bi_gettimeofday_improved() {
-	struct timeval time;
-	gettimeofday(&time, (struct timezone *) 0);
-	return ((double) time.tv_sec - d_bi_start_sec) + (double) time.tv_usec * 1.0e-6;
-}
-double (*bi_gettime)() = bi_gettimeofday_improved;
+#define FMADD_ILP_FMAS (1L<<23)				//fused multiply-adds per thread for every accumulator count of the ilp mode
 
-double mysecond()
-{
-	struct timeval tp;
-	struct timezone tzp;
-	int i;
+/* the kernels built into this binary, best ISA first */
+const fmadd_kernel_t fmadd_kernels[]={
+#ifdef __MIC__
+	{"knc", "single", 16, fmadd_avx512_ps, fmadd_avx512_ps_ilp, FMADD_ILP_ACCS(32)},
+	{"knc", "double", 8, fmadd_avx512_pd, fmadd_avx512_pd_ilp, FMADD_ILP_ACCS(32)},
+#else
+	{"avx512", "single", 16, fmadd_avx512_ps, fmadd_avx512_ps_ilp, FMADD_ILP_ACCS(32)},
+	{"avx512", "double", 8, fmadd_avx512_pd, fmadd_avx512_pd_ilp, FMADD_ILP_ACCS(32)},
+	{"avx2", "single", 8, fmadd_avx2_ps, fmadd_avx2_ps_ilp, FMADD_ILP_ACCS(16)},
+	{"avx2", "double", 4, fmadd_avx2_pd, fmadd_avx2_pd_ilp, FMADD_ILP_ACCS(16)},
+	{"avx", "single", 8, fmadd_avx_ps, fmadd_avx_ps_ilp, FMADD_ILP_ACCS(16)},
+	{"avx", "double", 4, fmadd_avx_pd, fmadd_avx_pd_ilp, FMADD_ILP_ACCS(16)},
+#endif
+	{NULL, NULL, 0, NULL, NULL, 0}
+};
 
-	i = gettimeofday(&tp,&tzp);
-	return ( (double) tp.tv_sec + (double) tp.tv_usec * 1.e-6 );
-}
-typedef struct 
+typedef struct
 {
 	float *mem;
 	void **ptr_per_core;
 	int tid;
 	int threads;
 	long size;
-	double time;
-	pthread_barrier_t *barrier;
+	int accs;
+	long reps;													//kernel calls in the timed run
+	double start;												//bi_gettime() when the thread started the kernel
+	double stop;												//bi_gettime() when it finished
+	const fmadd_kernel_t *kernel;
+	cnt_t cnt;													//PHI_COUNTERS of the timed run
+	barrier_t *barrier;
 }argc_t;
 
+#ifndef __MIC__
+static void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ ("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (0));
+}
+#endif
+/* returns nonzero if the CPU and the operating system support the ISA */
+static int isa_supported(const char *isa)
+{
+#ifdef __MIC__
+	return strcmp(isa, "knc")==0;
+#else
+	uint32_t eax, ebx, ecx, edx, max, xcr0_lo, xcr0_hi;
+	int avx, fma;
+	cpuid(0, &max, &ebx, &ecx, &edx);
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	fma=(ecx >> 12) & 1;
+	avx=(ecx >> 28) & 1;
+	if (!avx || !((ecx >> 27) & 1))						//no AVX or no OSXSAVE
+		return 0;
+	__asm__ __volatile__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0_lo & 0x6)!=0x6)							//the OS does not save the ymm registers
+		return 0;
+	if (strcmp(isa, "avx")==0)
+		return 1;
+	if (max<7)
+		return 0;
+	cpuid(7, &eax, &ebx, &ecx, &edx);
+	if (strcmp(isa, "avx2")==0)
+		return fma && ((ebx >> 5) & 1);
+	if (strcmp(isa, "avx512")==0)
+		return ((ebx >> 16) & 1) && (xcr0_lo & 0xe0)==0xe0;	//AVX-512F and the zmm and mask state
+	return 0;
+#endif
+}
+/* returns the kernel of the given precision for PHI_ISA, or for the best ISA of this CPU */
+static const fmadd_kernel_t *select_kernel(const char *precision)
+{
+	const char *isa=getenv("PHI_ISA");
+	const fmadd_kernel_t *k;
+	for (k=fmadd_kernels;k->isa!=NULL;++k)
+	{
+		if (strcmp(k->precision, precision)!=0)
+			continue;
+		if (isa!=NULL && strcmp(k->isa, isa)!=0)
+			continue;
+		if (isa_supported(k->isa))
+			return k;
+	}
+	return NULL;
+}
+
+/* 
+*	The function for each thread: all threads start calling the kernel arg->reps times together
+*	after a barrier and record their own start and stop times in arg->start and arg->stop
+*/
 void *thread (void *parm)
 {
 	argc_t *arg=(argc_t*)parm;
-	double results[2];
+	long r;
 
-	double start, stop;
+	cnt_open_thread(&arg->cnt, arg->tid);
+	arg->kernel->run(arg->mem);									//a pre-run
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	arg->start=bi_gettime();
+	for (r=0;r<arg->reps;++r)
+		arg->kernel->run(arg->mem);
+	arg->stop=bi_gettime();
+	cnt_stop(&arg->cnt);
+	cnt_close(&arg->cnt);
+	return NULL;
+}
+/* 
+*	Aggregates the times of the threads: returns the span from the earliest start to the
+*	latest stop, and the shortest and longest time of a single thread and the start skew
+*/
+double span (argc_t *info, int threads, double *min, double *max, double *skew)
+{
+	double first=info[0].start, last_start=info[0].start, last=info[0].stop;
 	int i;
-	#ifndef DOUBLE
-	__m512 a, b, c, d;
-	a=_mm512_set4_ps(1.1, 2.1, 3.1, 4.1);
-	b=_mm512_set4_ps(1.2, 2.2, 3.2, 4.2);
-	c=_mm512_set4_ps(1.3, 2.3, 3.3, 4.3);
-	#else
-	__m512d a, b, c, d;
-	a=_mm512_set4_pd(1.1, 2.1, 3.1, 4.1);
-	b=_mm512_set4_pd(1.2, 2.2, 3.2, 4.2);
-	c=_mm512_set4_pd(1.3, 2.3, 3.3, 4.3);
-	#endif
-	start=mysecond();
-        //pthread_barrier_wait(arg->barrier);
- 	//#pragma unroll
- 	for (i=0;i<100;++i)
- 	{
-		HUN
- 	}
-        //pthread_barrier_wait(arg->barrier);
-	stop=mysecond();
-	#ifndef DOUBLE
-	_mm512_store_ps(arg->mem,c);
-	#else
-	_mm512_store_pd(arg->mem,c);
-	#endif
-	if(arg->tid==0)
+	*min=*max=info[0].stop-info[0].start;
+	for ( i=1;i<threads;++i)
 	{
-		#ifndef DOUBLE
-		results[1]=arg->threads*100*100*3*2*16/(double)(stop-start);
-		#else
-		results[1]=arg->threads*100*100*3*2*8/(double)(stop-start);
-		#endif
-		printf ("#threads: %d, GFLOPS %f \n", arg->threads, results[1]/1000000000);
-	}	
+		double time=info[i].stop-info[i].start;
+		if (info[i].start<first)
+			first=info[i].start;
+		if (info[i].start>last_start)
+			last_start=info[i].start;
+		if (info[i].stop>last)
+			last=info[i].stop;
+		if (time<*min)
+			*min=time;
+		if (time>*max)
+			*max=time;
+	}
+	*skew=last_start-first;
+	return last-first;
+}
 
+/* 
+*	Finishes the output line of one run of flops floating-point operations with the counters
+*	per FLOP, and writes its record with the time of every thread as the samples, the
+*	precision of the runs in ad if it is not NULL and the frequency and power in pw
+*/
+static void emit (argc_t *info, int threads, const fmadd_kernel_t *kernel, const char *mode, double gflops, int accs, double flops, const adapt_t *ad, const pwr_t *pw)
+{
+	double samples[500], sum[CNT_MAX_EVENTS]={0};
+	char params[512];
+	result_t r={"fmadd", mode, "GFLOPS", gflops, samples, threads, threads, 0, NULL, params, NULL};
+	int i;
+	for (i=0;i<threads;++i)
+	{
+		samples[i]=info[i].stop-info[i].start;
+		cnt_add(sum, &info[i].cnt);
+	}
+	cnt_print(sum, flops, "FLOP");
+	printf ("\n");
+	if (!result_enabled())
+		return;
+	if (accs>0)
+		snprintf(params, sizeof(params), "isa=%s;precision=%s;accumulators=%d", kernel->isa, kernel->precision, accs);
+	else
+		snprintf(params, sizeof(params), "isa=%s;precision=%s", kernel->isa, kernel->precision);
+	pwr_params(params, sizeof(params), pw, gflops, "GFLOPS");
+	if (ad!=NULL)
+		adapt_params(params, sizeof(params), ad);
+	cnt_params(params, sizeof(params), sum, flops, "FLOP");
+	result_emit(&r);
 }
 
-int main (int argc, char **argv)
+/* 
+*	The function for each thread of the ilp mode: runs the kernel with arg->accs accumulators
+*	for arg->size iterations, started together with the other threads like thread()
+*/
+void *thread_ilp (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	fmadd_ilp_fn run=arg->kernel->ilp[arg->accs-1];
+	cnt_open_thread(&arg->cnt, arg->tid);
+	run(arg->size/10+1, arg->mem);								//a pre-run to bring the core up to its vector clock
+	barrier_wait(arg->barrier, arg->tid);
+	cnt_start(&arg->cnt);
+	arg->start=bi_gettime();
+	run(arg->size, arg->mem);
+	arg->stop=bi_gettime();
+	cnt_stop(&arg->cnt);
+	cnt_close(&arg->cnt);
+	return NULL;
+}
+/* 
+*	Sweeps the number of independent accumulators from 1 to kernel->max_accs on the given threads,
+*	beyond which the accumulators would not fit into the vector registers and spill to the stack.
+*	With one accumulator every FMA waits for the previous one, so cycles per FMA is the FMA latency;
+*	with enough accumulators (or SMT threads on a core) it approaches the reciprocal throughput.
+*	Cycles are counted at PHI_CPU_MHZ if set, otherwise at the clock measured over every run
+*	(power.h), or at the TSC frequency with PHI_POWER=off.
+*/
+int run_ilp (int threads, const fmadd_kernel_t *kernel)
 {
-	int threads;
 	pthread_t tid[500];
 	pthread_attr_t attr;
-	pthread_barrier_t barrier;
+	barrier_t barrier;
 	cpu_set_t set;
-	int i,tt;
-	threads=atoll(argv[1]);
 	argc_t info[500];
 	float mem[8000] __attribute__((aligned(64)));
-	pthread_barrier_init(&barrier, NULL, threads);
-	
+	double fixed = getenv("PHI_CPU_MHZ") ? atof(getenv("PHI_CPU_MHZ"))*1.0e6 : pwr_enabled() ? 0 : bi_tsc_hz;
+	double hz, time, min, max, skew, fmas, flops;
+	int i, accs;
+	pwr_t pw;
+
+	if (fixed>0)
+		printf ("Clock:\t%.0f MHz\n", fixed*1.0e-6);
+	barrier_init(&barrier, threads, -1);
+	for (accs=1;accs<=kernel->max_accs;++accs)
+	{
+		pwr_reset(&pw);
+		pwr_begin(&pw, threads);
+		for ( i=0;i<threads;++i)
+		{
+			info[i].tid=i;
+			info[i].barrier=&barrier;
+			info[i].threads=threads;
+			info[i].kernel=kernel;
+			info[i].accs=accs;
+			info[i].size=FMADD_ILP_FMAS/(FMADD_ILP_STEPS*accs);
+			info[i].mem=&mem[i*16];
+			pthread_attr_init(&attr);
+			CPU_ZERO(&set);
+			CPU_SET(placement_cpu(i), &set);//pin the thread to the coresponding core
+			pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+			pthread_create(&tid[i], &attr, thread_ilp, (void*) &info[i]);
+			pthread_attr_destroy(&attr);
+		}
+		for ( i=0;i<threads;++i)
+			pthread_join(tid[i], NULL);
+		pwr_end(&pw);
+		time=span(info, threads, &min, &max, &skew);
+		fmas=(double) info[0].size*FMADD_ILP_STEPS*accs;		//per thread
+		flops=threads*fmas*2*kernel->lanes;
+		hz = fixed>0 ? fixed : pwr_hz(&pw);
+		printf ("Accumulators:\t%d\tThreads:\t%d\tGFLOPS:\t%f\tFLOPs/cycle:\t%f\tCycles/FMA:\t%f",
+			accs, threads, flops/time/1000000000, flops/(time*hz), max*hz/fmas);
+		pwr_print(&pw, flops/time/1000000000, "GFLOPS");
+		emit(info, threads, kernel, "ilp", flops/time/1000000000, accs, flops, NULL, &pw);
+	}
+	barrier_destroy(&barrier);
+	return 0;
+}
+
+/* 
+*	Calls the kernel reps times on the given threads, all started together, and returns the
+*	span from the earliest start to the latest stop of any thread
+*/
+static double run_once (int threads, const fmadd_kernel_t *kernel, argc_t *info, barrier_t *barrier, float *mem, long reps, double *min, double *max, double *skew)
+{
+	pthread_t tid[500];
+	pthread_attr_t attr;
+	cpu_set_t set;
+	int i;
+
 	for ( i=0;i<threads;++i)
-	{	
+	{
 		info[i].tid=i;
 		info[i].threads=threads;
-		info[i].barrier=&barrier;
+		info[i].barrier=barrier;
+		info[i].kernel=kernel;
+		info[i].reps=reps;
 		info[i].mem=&mem[i*16];
 		pthread_attr_init(&attr);
 		CPU_ZERO(&set);
-		CPU_SET(i, &set);//pin the thread to the coresponding core
+		CPU_SET(placement_cpu(i), &set);//pin the thread to the coresponding core
 		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
-		pthread_create(&tid[i], &attr, thread, (void*) &info[i]);	
+		pthread_create(&tid[i], &attr, thread, (void*) &info[i]);
+		pthread_attr_destroy(&attr);
 	}
 	for ( i=0;i<threads;++i)
 	{
 		pthread_join(tid[i], NULL);
 	}
+	return span(info, threads, min, max, skew);
+}
+/* 
+*	Runs the kernel on the given threads and prints the GFLOPS over the span from the earliest
+*	start to the latest stop of any thread. With PHI_PRECISION, the kernel is called often enough
+*	for a long enough run, and the GFLOPS are over the mean span of the runs (adapt.h).
+*/
+static int run_threads (int threads, const fmadd_kernel_t *kernel)
+{
+	static argc_t info[500];
+	barrier_t barrier;
+	float mem[8000] __attribute__((aligned(64)));
+	double time, total=0, min, max, skew, flops;
+	long reps=1, r;
+	adapt_t ad;
+	pwr_t pw;
+
+	barrier_init(&barrier, threads, -1);
+	pwr_reset(&pw);
+	pwr_begin(&pw, threads);
+	time=run_once(threads, kernel, info, &barrier, mem, reps, &min, &max, &skew);
+	pwr_end(&pw);
+	if (adapt_enabled())
+	{
+		while ((r=adapt_scale(reps, time))!=reps)
+			time=run_once(threads, kernel, info, &barrier, mem, reps=r, &min, &max, &skew);
+		adapt_begin(&ad);
+		pwr_reset(&pw);
+		do
+		{
+			pwr_begin(&pw, threads);
+			time=run_once(threads, kernel, info, &barrier, mem, reps, &min, &max, &skew);
+			pwr_end(&pw);
+			total+=time;
+		}
+		while (adapt_more(&ad, time/reps));
+		time=total/ad.n;
+	}
+	//total flops over the span from the earliest start to the latest stop
+	flops=threads*reps*FMADD_ITERATIONS*100*3*2.0*kernel->lanes;
+	printf ("#threads: %d, GFLOPS %f \t", threads, flops/time/1000000000);
+	printf ("Thread time (us): min %.2f max %.2f\tStart skew (us): %.2f", min*1.0e6, max*1.0e6, skew*1.0e6);
+	if (pwr_enabled())
+		printf ("\tFLOPs/cycle:\t%f", flops/(time*pwr_hz(&pw)));
+	pwr_print(&pw, flops/time/1000000000, "GFLOPS");
+	if (adapt_enabled())
+		adapt_print(&ad);
+	emit(info, threads, kernel, "peak", flops/time/1000000000, 0, flops, adapt_enabled() ? &ad : NULL, &pw);
+	barrier_destroy(&barrier);
 	return 0;
 }
+
+/* the entry point of the in-process driver, see bench.h */
+int fmadd_run (int threads, const char *precision)
+{
+	static const fmadd_kernel_t *last=NULL;
+	const fmadd_kernel_t *kernel=select_kernel(precision);
+	if (kernel==NULL || threads<1 || threads>500)
+	{
+		printf ("Cannot run %d threads of a %s precision kernel\n", threads, precision);
+		return -1;
+	}
+	if (kernel!=last)
+		printf ("ISA:\t%s\tPrecision:\t%s\n", kernel->isa, kernel->precision);
+	last=kernel;
+	run_threads(threads, kernel);
+	fflush(stdout);
+	return 0;
+}
+
+#ifndef PHI_DRIVER
+int main (int argc, char **argv)
+{
+	int threads;
+	int ilp = argc>1 && strcmp(argv[1], "ilp")==0;
+	const char *precision = argc>2+ilp ? argv[2+ilp] : "single";
+	const fmadd_kernel_t *kernel;
+	if (argc<2)
+	{
+		printf ("Usage: %s <threads> [single|double] | ilp [threads] [single|double]\n", argv[0]);
+		return 1;
+	}
+	threads = ilp ? (argc>2 ? atoi(argv[2]) : 1) : atoll(argv[1]);
+	if (threads<1 || threads>500)
+	{
+		printf ("Cannot run %d threads\n", threads);
+		return 1;
+	}
+	kernel=select_kernel(precision);
+	if (kernel==NULL)
+	{
+		printf ("No %s precision kernel for ISA %s on this CPU\n", precision, getenv("PHI_ISA") ? getenv("PHI_ISA") : "any");
+		return 1;
+	}
+	bi_timer_init();
+	placement_init();
+	result_init();
+	cnt_init();
+	adapt_init();
+	pwr_init();
+	printf ("ISA:\t%s\tPrecision:\t%s\n", kernel->isa, kernel->precision);
+	if (ilp)
+		return run_ilp(threads, kernel);
+	return run_threads(threads, kernel);
+}
+#endif
@@ -0,0 +1,63 @@
+/********************************************************************
+ * Floating-point throughput kernels of fmadd.c
+ *
+ * Every kernel is generated from fmadd_kernel.h once per ISA and
+ * precision. Each ISA lives in its own file, compiled with its own
+ * target flags (see the Makefile):
+ *   fmadd_avx512.c - KNC IMCI (-mmic) or AVX-512F (KNL, Skylake-SP)
+ *   fmadd_avx2.c   - AVX2 with FMA3 (Haswell and later)
+ *   fmadd_avx.c    - AVX without FMA, a multiply and an add (Sandy Bridge)
+ * fmadd.c picks the best variant the CPU supports through CPUID, or the
+ * one named by the environment variable PHI_ISA (knc, avx512, avx2, avx).
+ *******************************************************************/
+
+#ifndef PHI_FMADD_H
+#define PHI_FMADD_H
+
+#define FMADD_ITERATIONS 10000			//iterations of the kernel loop, each 100 steps of 3 fused multiply-adds
+#define FMADD_MAX_ACCS 32				//largest number of independent accumulators of the ilp kernels
+#define FMADD_ILP_STEPS 8				//steps per iteration of the ilp kernels
+#define FMADD_ILP_OPERANDS 3			//vector registers of an ilp kernel besides its accumulators: b, c and s
+#define FMADD_ILP_ACCS(regs) ((regs)-FMADD_ILP_OPERANDS)	//accumulators that fit into regs vector registers
+
+#define FMADD_CAT_(a,b) a##b
+#define FMADD_CAT(a,b) FMADD_CAT_(a,b)
+
+/*!@brief A kernel runs FMADD_ITERATIONS*100*3 dependent fused multiply-adds
+ *        and stores its last vector to out, which has to be 64 byte aligned.
+ */
+typedef void (*fmadd_fn)(void *out);
+
+/*!@brief An ilp kernel with n accumulators runs iterations*FMADD_ILP_STEPS*n
+ *        fused multiply-adds, n independent chains interleaved, and stores
+ *        the sum of the accumulators to out (64 byte aligned).
+ */
+typedef void (*fmadd_ilp_fn)(long iterations, void *out);
+
+typedef struct
+{
+	const char *isa;					//"knc", "avx512", "avx2" or "avx"
+	const char *precision;				//"single" or "double"
+	int lanes;							//elements per vector
+	fmadd_fn run;
+	const fmadd_ilp_fn *ilp;			//ilp[n-1] has n accumulators
+	int max_accs;						//accumulators that fit into the vector registers, at most FMADD_MAX_ACCS
+}fmadd_kernel_t;
+
+/*!@brief All kernels built into this binary, best ISA first, terminated by an entry with isa NULL */
+extern const fmadd_kernel_t fmadd_kernels[];
+
+void fmadd_avx512_ps(void *out);
+void fmadd_avx512_pd(void *out);
+void fmadd_avx2_ps(void *out);
+void fmadd_avx2_pd(void *out);
+void fmadd_avx_ps(void *out);
+void fmadd_avx_pd(void *out);
+extern const fmadd_ilp_fn fmadd_avx512_ps_ilp[FMADD_MAX_ACCS];
+extern const fmadd_ilp_fn fmadd_avx512_pd_ilp[FMADD_MAX_ACCS];
+extern const fmadd_ilp_fn fmadd_avx2_ps_ilp[FMADD_MAX_ACCS];
+extern const fmadd_ilp_fn fmadd_avx2_pd_ilp[FMADD_MAX_ACCS];
+extern const fmadd_ilp_fn fmadd_avx_ps_ilp[FMADD_MAX_ACCS];
+extern const fmadd_ilp_fn fmadd_avx_pd_ilp[FMADD_MAX_ACCS];
+
+#endif
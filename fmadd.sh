@@ -1,10 +1,15 @@
+# fmadd-mic on KNC, all thread counts in one process of the driver everywhere else
+if [ -x ./fmadd-mic ] && [ "$(uname -m)" = "k1om" ]; then
 echo "Single precision"
 for (( i=4;i<=$1;i=i+4))
 do
-./fmadd-ps $i
+./fmadd-mic $i single
 done
 echo "Double precision"
 for (( i=4;i<=$1;i=i+4))
 do
-./fmadd-pd $i
+./fmadd-mic $i double
 done
+else
+./phibench "fmadd threads=4-$1:4 precision=single precision=double"
+fi
@@ -0,0 +1,24 @@
+/********************************************************************
+ * 256-bit kernels for AVX hosts without FMA: every fused multiply-add
+ * is a multiply and a dependent add, still counted as 2 flops. Not
+ * for KNC.
+ *******************************************************************/
+
+#include <immintrin.h>
+#include "fmadd.h"
+
+#ifndef __MIC__
+#define KERNEL fmadd_avx_ps
+#define VEC __m256
+#define SET(x,y,z,w) _mm256_set_ps(x,y,z,w,x,y,z,w)
+#define FMADD(a,b,c) _mm256_add_ps(_mm256_mul_ps(a,b),c)
+#define STORE(p,v) _mm256_store_ps(p,v)
+#include "fmadd_kernel.h"
+
+#define KERNEL fmadd_avx_pd
+#define VEC __m256d
+#define SET(x,y,z,w) _mm256_set_pd(x,y,z,w)
+#define FMADD(a,b,c) _mm256_add_pd(_mm256_mul_pd(a,b),c)
+#define STORE(p,v) _mm256_store_pd(p,v)
+#include "fmadd_kernel.h"
+#endif
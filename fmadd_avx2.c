@@ -0,0 +1,22 @@
+/********************************************************************
+ * 256-bit fmadd kernels with FMA3 (AVX2 hosts), not for KNC
+ *******************************************************************/
+
+#include <immintrin.h>
+#include "fmadd.h"
+
+#ifndef __MIC__
+#define KERNEL fmadd_avx2_ps
+#define VEC __m256
+#define SET(x,y,z,w) _mm256_set_ps(x,y,z,w,x,y,z,w)
+#define FMADD(a,b,c) _mm256_fmadd_ps(a,b,c)
+#define STORE(p,v) _mm256_store_ps(p,v)
+#include "fmadd_kernel.h"
+
+#define KERNEL fmadd_avx2_pd
+#define VEC __m256d
+#define SET(x,y,z,w) _mm256_set_pd(x,y,z,w)
+#define FMADD(a,b,c) _mm256_fmadd_pd(a,b,c)
+#define STORE(p,v) _mm256_store_pd(p,v)
+#include "fmadd_kernel.h"
+#endif
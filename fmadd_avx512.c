@@ -0,0 +1,21 @@
+/********************************************************************
+ * 512-bit fmadd kernels: KNC IMCI when built with -mmic, otherwise
+ * AVX-512F (KNL, Skylake-SP). The intrinsics are the same for both.
+ *******************************************************************/
+
+#include <immintrin.h>
+#include "fmadd.h"
+
+#define KERNEL fmadd_avx512_ps
+#define VEC __m512
+#define SET(x,y,z,w) _mm512_set4_ps(x,y,z,w)
+#define FMADD(a,b,c) _mm512_fmadd_ps(a,b,c)
+#define STORE(p,v) _mm512_store_ps(p,v)
+#include "fmadd_kernel.h"
+
+#define KERNEL fmadd_avx512_pd
+#define VEC __m512d
+#define SET(x,y,z,w) _mm512_set4_pd(x,y,z,w)
+#define FMADD(a,b,c) _mm512_fmadd_pd(a,b,c)
+#define STORE(p,v) _mm512_store_pd(p,v)
+#include "fmadd_kernel.h"
@@ -0,0 +1,75 @@
+/********************************************************************
+ * Template of the fmadd kernels with ACCS independent accumulators,
+ * included by fmadd_kernel.h once for every ACCS from 1 to
+ * FMADD_MAX_ACCS, with the macros of fmadd_kernel.h still defined.
+ * Every step applies one fused multiply-add to every accumulator, so
+ * one accumulator measures the FMA latency and enough of them the FMA
+ * throughput. Besides the accumulators a kernel keeps b, c and s in
+ * registers (FMADD_ILP_OPERANDS), so the compiler spills accumulators
+ * to the stack above 13 with the 16 registers of AVX and AVX2 and above
+ * 29 with the 32 of AVX-512 and KNC; the ilp mode stops at max_accs of
+ * the kernel (fmadd.h) instead of measuring the spills. ACCS is
+ * undefined again at the end.
+ *******************************************************************/
+
+#ifndef PHI_FMADD_ILP_H
+#define PHI_FMADD_ILP_H
+/* ILP_UPTOn(op) expands to op(1) op(2) ... op(n) */
+#define ILP_UPTO1(op) op(1)
+#define ILP_UPTO2(op) ILP_UPTO1(op) op(2)
+#define ILP_UPTO3(op) ILP_UPTO2(op) op(3)
+#define ILP_UPTO4(op) ILP_UPTO3(op) op(4)
+#define ILP_UPTO5(op) ILP_UPTO4(op) op(5)
+#define ILP_UPTO6(op) ILP_UPTO5(op) op(6)
+#define ILP_UPTO7(op) ILP_UPTO6(op) op(7)
+#define ILP_UPTO8(op) ILP_UPTO7(op) op(8)
+#define ILP_UPTO9(op) ILP_UPTO8(op) op(9)
+#define ILP_UPTO10(op) ILP_UPTO9(op) op(10)
+#define ILP_UPTO11(op) ILP_UPTO10(op) op(11)
+#define ILP_UPTO12(op) ILP_UPTO11(op) op(12)
+#define ILP_UPTO13(op) ILP_UPTO12(op) op(13)
+#define ILP_UPTO14(op) ILP_UPTO13(op) op(14)
+#define ILP_UPTO15(op) ILP_UPTO14(op) op(15)
+#define ILP_UPTO16(op) ILP_UPTO15(op) op(16)
+#define ILP_UPTO17(op) ILP_UPTO16(op) op(17)
+#define ILP_UPTO18(op) ILP_UPTO17(op) op(18)
+#define ILP_UPTO19(op) ILP_UPTO18(op) op(19)
+#define ILP_UPTO20(op) ILP_UPTO19(op) op(20)
+#define ILP_UPTO21(op) ILP_UPTO20(op) op(21)
+#define ILP_UPTO22(op) ILP_UPTO21(op) op(22)
+#define ILP_UPTO23(op) ILP_UPTO22(op) op(23)
+#define ILP_UPTO24(op) ILP_UPTO23(op) op(24)
+#define ILP_UPTO25(op) ILP_UPTO24(op) op(25)
+#define ILP_UPTO26(op) ILP_UPTO25(op) op(26)
+#define ILP_UPTO27(op) ILP_UPTO26(op) op(27)
+#define ILP_UPTO28(op) ILP_UPTO27(op) op(28)
+#define ILP_UPTO29(op) ILP_UPTO28(op) op(29)
+#define ILP_UPTO30(op) ILP_UPTO29(op) op(30)
+#define ILP_UPTO31(op) ILP_UPTO30(op) op(31)
+#define ILP_UPTO32(op) ILP_UPTO31(op) op(32)
+#define ILP_DECL(k) VEC x##k=SET(1.0+k, 2.0+k, 3.0+k, 4.0+k);
+#define ILP_STEP(k) x##k=FMADD(x##k,b,c);
+#define ILP_SUM(k) s=FMADD(x##k,b,s);
+#define ILP_NAME(k) FMADD_CAT(FMADD_CAT(KERNEL, _ilp), k),
+#endif
+
+#define ILP_ALL(op) FMADD_CAT(ILP_UPTO, ACCS)(op)
+
+void FMADD_CAT(FMADD_CAT(KERNEL, _ilp), ACCS)(long iterations, void *out)
+{
+	VEC b=SET(0.999, 0.998, 0.997, 0.996);				//|b|<1, so the accumulators stay finite
+	VEC c=SET(0.001, 0.002, 0.003, 0.004);
+	VEC s=SET(0.0, 0.0, 0.0, 0.0);
+	long i;
+	ILP_ALL(ILP_DECL)
+	for (i=0;i<iterations;++i)
+	{
+		ILP_ALL(ILP_STEP) ILP_ALL(ILP_STEP) ILP_ALL(ILP_STEP) ILP_ALL(ILP_STEP)
+		ILP_ALL(ILP_STEP) ILP_ALL(ILP_STEP) ILP_ALL(ILP_STEP) ILP_ALL(ILP_STEP)
+	}
+	ILP_ALL(ILP_SUM)
+	STORE(out, s);
+}
+
+#undef ILP_ALL
+#undef ACCS
@@ -0,0 +1,108 @@
+/********************************************************************
+ * Template of the fmadd kernels, included by fmadd_<isa>.c once per
+ * precision after defining
+ *   KERNEL          the name of the function
+ *   VEC             the vector type
+ *   SET(x,y,z,w)    a vector of the four values, repeated
+ *   FMADD(a,b,c)    a*b+c
+ *   STORE(p,v)      an aligned store of v to p
+ * Besides KERNEL, it generates KERNEL_ilp1 ... KERNEL_ilp32 from
+ * fmadd_ilp.h and the table KERNEL_ilp of them. All macros are
+ * undefined again at the end, so there is no include guard on purpose.
+ *******************************************************************/
+
+#define ONE {a=FMADD(a,b,c);b=FMADD(a,b,c);c=FMADD(a,b,c);}
+#define TEN ONE ONE ONE ONE ONE ONE ONE ONE ONE ONE
+#define HUN TEN TEN TEN TEN TEN TEN TEN TEN TEN TEN
+
+void KERNEL(void *out)
+{
+	VEC a, b, c;
+	int i;
+	a=SET(1.1, 2.1, 3.1, 4.1);
+	b=SET(1.2, 2.2, 3.2, 4.2);
+	c=SET(1.3, 2.3, 3.3, 4.3);
+	for (i=0;i<FMADD_ITERATIONS;++i)
+	{
+		HUN
+	}
+	STORE(out, c);
+}
+
+#define ACCS 1
+#include "fmadd_ilp.h"
+#define ACCS 2
+#include "fmadd_ilp.h"
+#define ACCS 3
+#include "fmadd_ilp.h"
+#define ACCS 4
+#include "fmadd_ilp.h"
+#define ACCS 5
+#include "fmadd_ilp.h"
+#define ACCS 6
+#include "fmadd_ilp.h"
+#define ACCS 7
+#include "fmadd_ilp.h"
+#define ACCS 8
+#include "fmadd_ilp.h"
+#define ACCS 9
+#include "fmadd_ilp.h"
+#define ACCS 10
+#include "fmadd_ilp.h"
+#define ACCS 11
+#include "fmadd_ilp.h"
+#define ACCS 12
+#include "fmadd_ilp.h"
+#define ACCS 13
+#include "fmadd_ilp.h"
+#define ACCS 14
+#include "fmadd_ilp.h"
+#define ACCS 15
+#include "fmadd_ilp.h"
+#define ACCS 16
+#include "fmadd_ilp.h"
+#define ACCS 17
+#include "fmadd_ilp.h"
+#define ACCS 18
+#include "fmadd_ilp.h"
+#define ACCS 19
+#include "fmadd_ilp.h"
+#define ACCS 20
+#include "fmadd_ilp.h"
+#define ACCS 21
+#include "fmadd_ilp.h"
+#define ACCS 22
+#include "fmadd_ilp.h"
+#define ACCS 23
+#include "fmadd_ilp.h"
+#define ACCS 24
+#include "fmadd_ilp.h"
+#define ACCS 25
+#include "fmadd_ilp.h"
+#define ACCS 26
+#include "fmadd_ilp.h"
+#define ACCS 27
+#include "fmadd_ilp.h"
+#define ACCS 28
+#include "fmadd_ilp.h"
+#define ACCS 29
+#include "fmadd_ilp.h"
+#define ACCS 30
+#include "fmadd_ilp.h"
+#define ACCS 31
+#include "fmadd_ilp.h"
+#define ACCS 32
+#include "fmadd_ilp.h"
+
+const fmadd_ilp_fn FMADD_CAT(KERNEL, _ilp)[FMADD_MAX_ACCS]={
+	ILP_UPTO32(ILP_NAME)
+};
+
+#undef ONE
+#undef TEN
+#undef HUN
+#undef KERNEL
+#undef VEC
+#undef SET
+#undef FMADD
+#undef STORE
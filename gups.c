@@ -0,0 +1,241 @@
+/********************************************************************
+ * Random access updates (GUPS): every thread applies table[i]^=r for
+ * random numbers r of its own rng.h stream, at i = r scaled onto the
+ * table, like HPCC RandomAccess. The updates are independent of each
+ * other: each batch of GUPS_BATCH random numbers is generated first and
+ * then applied, so that many loads and stores are in flight, unlike the
+ * dependent loads of the latency chase.
+ *
+ * Two variants: scalar updates, and the same batches with AVX-512
+ * gathers and scatters of 8 updates each. All threads update the whole
+ * table without locks, so concurrent updates of one entry may be lost,
+ * as in RandomAccess; the table is not verified.
+ *
+ * Usage: gups [threads] [table MB] [scalar|gather|all]
+ * measures 1, 2, 4, ... up to [threads] threads (by default, the length
+ * of the placement list). The table is placed by PHI_MEMORY (the buffer
+ * "table", see memory.h), in MCDRAM with -DMCDRAM and in DDR otherwise
+ * by default.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <immintrin.h>
+#include "timer.h"
+#include "placement.h"
+#include "memory.h"
+#include "rng.h"
+#include "result.h"
+#include "counters.h"
+#include "barrier.h"
+
+#define MAX_NUM_THREADS 288
+#define GUPS_TABLE_SIZE (1024L*1024*1024)			//default bytes of the table
+#define GUPS_UPDATES (1L<<23)						//updates per thread and timed run
+#define GUPS_BATCH 64								//independent updates in flight, a multiple of 8
+#define NTIMES 5									//timed runs of every point, the best one is reported
+
+enum {GUPS_SCALAR, GUPS_GATHER, GUPS_VARIANTS};
+static const char *variant_name[GUPS_VARIANTS]={"scalar", "gather"};
+
+typedef struct
+{
+	uint64_t *table;
+	uint64_t entries;
+	int tid;
+	int variant;
+	double time[NTIMES];						//of every timed run
+	double counts[CNT_MAX_EVENTS];				//PHI_COUNTERS over the timed runs
+	barrier_t *barrier;
+}argc_t;
+
+/* the indices and values of the next batch, from the stream of the thread */
+static inline void batch (rng_t *rng, uint64_t entries, uint64_t *idx, uint64_t *r)
+{
+	int j;
+	for (j=0;j<GUPS_BATCH;++j)
+	{
+		r[j]=rng_next(rng);
+		idx[j]=rng_scale(r[j], entries);
+	}
+}
+static void update_scalar (uint64_t *table, uint64_t entries, rng_t *rng, long updates)
+{
+	uint64_t idx[GUPS_BATCH], r[GUPS_BATCH];
+	long u;
+	int j;
+
+	for (u=0;u<updates;u+=GUPS_BATCH)
+	{
+		batch(rng, entries, idx, r);
+		for (j=0;j<GUPS_BATCH;++j)
+			table[idx[j]]^=r[j];
+	}
+}
+/* 8 updates per gather and scatter; two equal indices in one vector lose one of their updates */
+static void update_gather (uint64_t *table, uint64_t entries, rng_t *rng, long updates)
+{
+	uint64_t idx[GUPS_BATCH] __attribute__((aligned(64)));
+	uint64_t r[GUPS_BATCH] __attribute__((aligned(64)));
+	long u;
+	int j;
+
+	for (u=0;u<updates;u+=GUPS_BATCH)
+	{
+		batch(rng, entries, idx, r);
+		for (j=0;j<GUPS_BATCH;j+=8)
+		{
+			__m512i vi=_mm512_load_epi64(&idx[j]);
+			__m512i v=_mm512_i64gather_epi64(vi, (const void *) table, sizeof(uint64_t));
+			v=_mm512_xor_epi64(v, _mm512_load_epi64(&r[j]));
+			_mm512_i64scatter_epi64((void *) table, vi, v, sizeof(uint64_t));
+		}
+	}
+}
+/* the function of each thread: NTIMES timed runs of GUPS_UPDATES updates between two barriers */
+void *thread (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	cnt_t cnt;
+	rng_t rng;
+	double start;
+	int k;
+
+	rng_seed(&rng, arg->tid+1);
+	memset(arg->counts, 0, sizeof(arg->counts));
+	cnt_open_thread(&cnt, arg->tid);
+	for (k=0;k<NTIMES;++k)
+	{
+		barrier_wait(arg->barrier, arg->tid);
+		cnt_start(&cnt);
+		start=bi_gettime();
+		if (arg->variant==GUPS_GATHER)
+			update_gather(arg->table, arg->entries, &rng, GUPS_UPDATES);
+		else
+			update_scalar(arg->table, arg->entries, &rng, GUPS_UPDATES);
+		barrier_wait(arg->barrier, arg->tid);
+		arg->time[k]=bi_gettime()-start;
+		cnt_stop(&cnt);
+		cnt_add(arg->counts, &cnt);
+	}
+	cnt_close(&cnt);
+	return NULL;
+}
+
+/* runs one variant on threads threads and prints its updates per second; returns 0 or -1 */
+static int run (uint64_t *table, uint64_t entries, int threads, int variant)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	cpu_set_t set;
+	barrier_t barrier;
+	static argc_t info[MAX_NUM_THREADS];
+	double samples[NTIMES], counts[CNT_MAX_EVENTS]={0}, best=0, gups;
+	int tt, k;
+
+	if (barrier_init(&barrier, threads, -1)!=0)
+	{
+		printf ("Cannot create a barrier for %d threads\n", threads);
+		return -1;
+	}
+	for (tt=0;tt<threads;++tt)
+	{
+		info[tt].table=table;
+		info[tt].entries=entries;
+		info[tt].tid=tt;
+		info[tt].variant=variant;
+		info[tt].barrier=&barrier;
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(tt), &set);//pin the thread to the coresponding core
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		if (pthread_create(&tid[tt], &attr, thread, (void*) &info[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", placement_cpu(tt));
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (tt=0;tt<threads;++tt)
+		pthread_join(tid[tt], NULL);
+	barrier_destroy(&barrier);
+	//every run takes as long as its slowest thread
+	for (k=0;k<NTIMES;++k)
+	{
+		samples[k]=0;
+		for (tt=0;tt<threads;++tt)
+			if (info[tt].time[k]>samples[k])
+				samples[k]=info[tt].time[k];
+		if (k==0 || samples[k]<best)
+			best=samples[k];
+	}
+	for (tt=0;tt<threads;++tt)
+		for (k=0;k<cnt_events();++k)
+			counts[k]+=info[tt].counts[k];
+	gups=(double) threads*GUPS_UPDATES/best/1000000000;
+	printf ("Threads:\t%d\tVariant:\t%s\tGUPS:\t%f\tPer thread (MUPS):\t%f", threads, variant_name[variant], gups, gups*1000/threads);
+	cnt_print(counts, (double) threads*GUPS_UPDATES*NTIMES, "update");
+	printf ("\n");
+	if (result_enabled())
+	{
+		char params[512];
+		result_t r={"gups", variant_name[variant], "GUPS", gups, samples, NTIMES, threads, (long) (entries*sizeof(uint64_t)), mem_kind_name(mem_kind_of(table)), params, mem_page_of(table)};
+		snprintf (params, sizeof(params), "updates=%ld;batch=%d", GUPS_UPDATES, GUPS_BATCH);
+		cnt_params(params, sizeof(params), counts, (double) threads*GUPS_UPDATES*NTIMES, "update");
+		result_emit(&r);
+	}
+	fflush(stdout);
+	return 0;
+}
+
+int main (int argc, char **argv)
+{
+	uint64_t *table, entries, i;
+	int threads, max_threads, first=GUPS_SCALAR, last=GUPS_GATHER, v, err=0;
+
+	bi_timer_init();
+	placement_init();
+	mem_init();
+	result_init();
+	cnt_init();
+	max_threads = argc>1 ? atoi(argv[1]) : placement_count();
+	entries = (argc>2 ? atol(argv[2])*1024*1024 : GUPS_TABLE_SIZE)/sizeof(uint64_t);
+	if (argc>3 && strcmp(argv[3], "scalar")==0)
+		last=GUPS_SCALAR;
+	else if (argc>3 && strcmp(argv[3], "gather")==0)
+		first=GUPS_GATHER;
+	else if (argc>3 && strcmp(argv[3], "all")!=0)
+		max_threads=0;
+	if (max_threads<1 || max_threads>MAX_NUM_THREADS || entries<1)
+	{
+		printf ("Usage: %s [threads] [table MB] [scalar|gather|all], at most %d threads\n", argv[0], MAX_NUM_THREADS);
+		return 1;
+	}
+	table=(uint64_t *) mem_alloc(entries*sizeof(uint64_t), mem_kind_for("table"));
+	if (table==NULL)
+	{
+		printf ("Cannot allocate a table of %lu entries\n", (unsigned long) entries);
+		return 1;
+	}
+	for (i=0;i<entries;++i)
+		table[i]=i;
+	printf ("Memory:\t%s\tPages:\t%s\tTable size:\t%lu bytes\tBatch:\t%d\n", mem_kind_name(mem_kind_of(table)), mem_page_of(table), (unsigned long) (entries*sizeof(uint64_t)), GUPS_BATCH);
+	for (threads=1;;threads=2*threads<max_threads ? 2*threads : max_threads)
+	{
+		for (v=first;v<=last;++v)
+			if (run(table, entries, threads, v)!=0)
+				err=1;
+		if (threads==max_threads)
+			break;
+	}
+	mem_free(table);
+	return err;
+}
@@ -0,0 +1 @@
+./gups $1
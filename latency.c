@@ -1,7 +1,18 @@
 #define _GNU_SOURCE
 #include "interface.h"
+#include "timer.h"
+#include "placement.h"
+#include "memory.h"
+#include "rng.h"
+#include "result.h"
+#include "counters.h"
+#include "barrier.h"
+#include "cache.h"
+#include "adapt.h"
+#include "power.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -11,6 +22,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <immintrin.h>
 #define ONE {ptr=(void **) *ptr;}
 #define TEN ONE ONE ONE ONE ONE ONE ONE ONE ONE ONE
 #define HUN TEN TEN TEN TEN TEN TEN TEN TEN TEN TEN
@@ -20,103 +32,131 @@
 #define MEMORY_NUMBER_OF_JUMPS (1024*1024)			//total number of jumps for the memory latency measurement
 #define L2_CACHE_MAX_ACCESS_LENGTH 512*1024				//total length of memory space for L2 latency measurement, the actual size is L2_CACHE_MAX_ACCESS_LENGTH * sizeof(double)
 #define L2_CACHE_NUMBER_OF_JUMPS 512*1024				//total number of jumps for L2 latency measurement
+#define MAX_NUM_THREADS 288
+#define MATRIX_CHAIN_SIZE (256*1024)					//bytes of the chain each core keeps in its L2 for the latency matrix
+#define CHAIN_STRIDE 64									//default distance of two chain nodes in bytes, one cache line
+#define SWEEP_MIN_SIZE (4L*1024)						//smallest working set of the sweep mode, in bytes
+#define SWEEP_MAX_SIZE (4L*1024*1024*1024)				//largest working set of the sweep mode, in bytes
+#define SWEEP_STEPS_PER_OCTAVE 4						//working sets per doubling of the size in the sweep mode
+#define LOADED_CHAIN_SIZE (256L*1024*1024)				//bytes of the chain chased in the loaded mode, far beyond the caches
+#define LOAD_ARRAY_SIZE (16L*1024*1024)					//most floats per array of each load thread (64 MB)
+#define LOAD_TOTAL_SIZE (6L*1024*1024*1024)				//bytes of the arrays of all load threads, far beyond the caches
+#define LOAD_CHUNK 1024									//floats a load thread streams between two delays (4 KB)
+#define LATENCY_SAMPLES 8								//timed parts of a chase, the samples of the results
+#define HISTOGRAM_CHAIN_SIZE (256L*1024*1024)			//default bytes of the chain of the histogram mode
+#define HISTOGRAM_JUMPS (16L*1024*1024)					//jumps timed by the histogram mode
+#define HISTOGRAM_BATCH 16								//default jumps between two time stamps of the histogram mode
+#define HISTOGRAM_STEPS_PER_OCTAVE 8						//buckets per doubling of the latency
+#define HISTOGRAM_BUCKETS (32*HISTOGRAM_STEPS_PER_OCTAVE)	//buckets from 1 TSC cycle up
+#define MLP_CHAIN_SIZE (64L*1024*1024)					//default bytes of the chain of every thread of the mlp mode
+#define MLP_JUMPS (4L*1024*1024)							//jumps of every thread of the mlp mode, over all of its chains
+#define MLP_MAX_CHAINS 16								//most independent chains per thread of the mlp mode
+#define COHERENCE_OPS 10000								//round trips or operations timed per cell of the coherence mode
+#define BARRIER_EPISODES 10000							//barriers timed back to back per point of the barrier mode
+#define BARRIER_SKEW_EPISODES 1000						//barriers of the barrier mode whose exits are time stamped
 
-double d_bi_start_sec; /**< start time */
-static double bi_gettimeofday() {
-	struct timeval time;
-	gettimeofday(&time, (struct timezone *) 0);
-	return (double) time.tv_sec + (double) time.tv_usec * 1.0e-6;
-}
-static double bi_gettimeofday_improved() {
-	struct timeval time;
-	gettimeofday(&time, (struct timezone *) 0);
-	return ((double) time.tv_sec - d_bi_start_sec) + (double) time.tv_usec * 1.0e-6;
-}
-double (*bi_gettime)() = bi_gettimeofday_improved;
-
-unsigned int random_number(unsigned long max);
-void make_linked_memory(void *mem, long count);
+long make_linked_memory(void *mem, long length);
 
 long numjumps;
+long chain_stride=CHAIN_STRIDE;									//bytes between two nodes of a chain, PHI_STRIDE
+int chain_threads=1;											//threads that link a chain, PHI_CHAIN_THREADS
 
-int NUM_COUNTERS;
-
-/** generates a random number between 0 and (max-1)
- *  @param  max maximum random number
- *  @return a random number between 0 and (max-1)
- */
-unsigned int random_number(unsigned long max)
+typedef struct
 {
-  return (unsigned int) (((double)max)*rand()/(RAND_MAX+1.0));
-}
-double mysecond()
-{
-	struct timeval tp;
-	struct timezone tzp;
-	int i;
+  char *mem;
+  uint32_t *order;
+  long from, to, num_nodes;
+}link_t;
 
-	i = gettimeofday(&tp,&tzp);
-	return ( (double) tp.tv_sec + (double) tp.tv_usec * 1.e-6 );
+/* writes order[from..to) = from..to-1 */
+static void *init_order(void *parm) {
+  link_t *arg=(link_t*)parm;
+  long i;
+  for(i=arg->from; i<arg->to; i++)
+    arg->order[i]=(uint32_t) i;
+  return NULL;
 }
-
-/** creates a memory are that is randomly linked 
+/* links node order[i] to node order[i+1] for i in [from, to), the last node back to the first */
+static void *link_nodes(void *parm) {
+  link_t *arg=(link_t*)parm;
+  long i, next;
+  for(i=arg->from; i<arg->to; i++) {
+    next=(i+1<arg->num_nodes) ? arg->order[i+1] : arg->order[0];
+    *(void **)(arg->mem+arg->order[i]*chain_stride)=(void *)(arg->mem+next*chain_stride);
+  }
+  return NULL;
+}
+/* runs fn over [0, num_nodes) split across chain_threads threads */
+static void for_all_nodes(void *(*fn)(void *), char *mem, uint32_t *order, long num_nodes) {
+  pthread_t tid[MAX_NUM_THREADS];
+  link_t part[MAX_NUM_THREADS];
+  int t, threads=chain_threads;
+  if(threads<1 || num_nodes<1024*threads)
+    threads=1;
+  if(threads>MAX_NUM_THREADS)
+    threads=MAX_NUM_THREADS;
+  for(t=0; t<threads; t++) {
+    part[t].mem=mem;
+    part[t].order=order;
+    part[t].num_nodes=num_nodes;
+    part[t].from=num_nodes*t/threads;
+    part[t].to=num_nodes*(t+1)/threads;
+    if(t>0)
+      pthread_create(&tid[t], NULL, fn, (void*) &part[t]);
+  }
+  fn((void*) &part[0]);
+  for(t=1; t<threads; t++)
+    pthread_join(tid[t], NULL);
+}
+/** creates a memory area that is randomly linked, one node every chain_stride bytes
+ *  so every jump goes to a different cache line (or page)
+ *  the nodes form one random cycle that starts and ends at mem
  *  @param mem     the memory area to be used
  *  @param length  the number of bytes that should be used
+ *  @return the number of nodes in the chain
  */
-void make_linked_memory(void *mem, long length) {
-
-  /* some pointers to generate the list */
-  void **ptr, **first;
-  /** how many ptr we create within the memory */
-  long num_ptr=length;///sizeof(void *);
-  /** the list for all memory locations that are linked */
-  long *ptr_numbers;
+long make_linked_memory(void *mem, long length) {
+
+  /** how many nodes we create within the memory */
+  long num_nodes=length/chain_stride;
+  /** the order in which the nodes are visited */
+  uint32_t *order;
   /** for the loops */
-  long loop_ptrs;
-  /** actual random number */
-  long act_num;
+  long i, j;
+  uint32_t tmp;
+  rng_t rng;
 
-  /* allocate memory for ptr numbers */
-  ptr_numbers=(long *) malloc(num_ptr*sizeof(long));
-  if(num_ptr>0 && ptr_numbers==NULL)
+  if(num_nodes<1 || num_nodes>UINT32_MAX)
+    {
+      printf("cannot link %ld nodes in make_linked_mem()\n", num_nodes);
+      bi_cleanup(mem);
+      exit(1);
+    }
+  /* allocate memory for the visiting order */
+  order=(uint32_t *) malloc(num_nodes*sizeof(uint32_t));
+  if(order==NULL)
     {
       printf("no more core in make_linked_mem()\n");
       bi_cleanup(mem);
       exit(1);
     }
-  /* initialize ptr numbers, the 0 is used as the first
-   * number
-   */
-  for(loop_ptrs=1; loop_ptrs<num_ptr; loop_ptrs++)
-    ptr_numbers[loop_ptrs-1]=loop_ptrs;
-
-  /* init first ptr with first memory location */
-  ptr=(void **)mem;
-  first=ptr;
-   
-  num_ptr--;
-
-  while(num_ptr>1) {
-    /* get a random position within the
-       remaining list */
-    act_num=random_number(num_ptr);
-    /* create a link from the last ptr 
-       to this ptr */
-    *ptr=(void *) (first+ptr_numbers[act_num]);
-    /* move pointer to new memory location */
-    ptr=first+ptr_numbers[act_num];
-    /* remove used ptr number from list of
-       pointer numbers, just copies the last 
-       number to the actual position */
-    ptr_numbers[act_num]=ptr_numbers[num_ptr-1];
-    num_ptr--;
+  for_all_nodes(init_order, (char *) mem, order, num_nodes);
+
+  /* Fisher-Yates shuffle of all nodes but the first, which stays
+   * at mem where jump_around() starts: O(n) and uniform */
+  rng_seed(&rng, 0x5eed);
+  for(i=num_nodes-1; i>1; i--) {
+    j=1+(long) rng_below(&rng, i);
+    tmp=order[i];
+    order[i]=order[j];
+    order[j]=tmp;
   }
 
-  /* the last number is linked to the first */
-  *ptr=(void *) first;
+  /* link every node to its successor in the order */
+  for_all_nodes(link_nodes, (char *) mem, order, num_nodes);
 
-  /* free the ptr list */
-  free(ptr_numbers);
+  free(order);
+  return num_nodes;
 }
 /* Conducts pointer chasing
 *  @mem, the memory space to chase pointers
@@ -135,8 +175,101 @@ void *jump_around(void *mem, long n) {
 	return (void *) ptr;
 }
 
+/* Conducts n jumps of pointer chasing, one at a time */
+static void *jump_batch(void *mem, long n) {
+	void **ptr=(void **) mem;
+	long a;
+
+	for(a=0;a<n;a++){
+		ONE
+	}
+	return (void *) ptr;
+}
+/* 
+*	Chases about n pointers from mem in LATENCY_SAMPLES timed parts, each one continuing where
+*	the previous one stopped. With --cold, every part is one pass over the nodes of the chain
+*	right after the chain has been flushed from the caches and the TLB. With PHI_PRECISION, the
+*	parts are lengthened until one is long enough and repeated until the latency is precise
+*	enough, see adapt.h. Stores the seconds of every part in samples (ADAPT_MAX_RUNS of them at
+*	most) and their number in *nsamples, the PHI_COUNTERS of the whole chase in counts, the
+*	frequency and power of its parts in pw and the jumps in *jumps, returns the average latency
+*	in ns.
+*/
+static double chase(void *mem, long nodes, long n, double *samples, int *nsamples, double *counts, long *jumps, adapt_t *ad, pwr_t *pw) {
+	void *ptr=mem;
+	double total=0, time;
+	long part = bi_cold ? nodes : n/LATENCY_SAMPLES/100*100, longer;
+	cnt_t cnt;
+	int s, more;
+
+	*jumps=0;
+	memset(counts, 0, CNT_MAX_EVENTS*sizeof(double));
+	cnt_open(&cnt);
+	while (adapt_enabled() && !bi_cold)
+	{
+		//parts that are too short are not counted, jump_around() goes in hundreds
+		bi_startTimer();
+		ptr=jump_around(ptr, part);
+		time=bi_stopTimer();
+		longer=(adapt_scale(part, time)+99)/100*100;
+		if (longer==part)
+			break;
+		part=longer;
+	}
+	adapt_begin(ad);
+	pwr_reset(pw);
+	for (s=0, more=1; more; ++s)
+	{
+		if (bi_cold)
+		{
+			bi_flushRegion(mem, nodes*chain_stride);
+			bi_flushTLB();
+		}
+		pwr_begin(pw, 1);
+		cnt_start(&cnt);
+		bi_startTimer();
+		if (bi_cold)
+			ptr=jump_batch(ptr, nodes);
+		else
+			ptr=jump_around(ptr, part);
+		samples[s]=bi_stopTimer();
+		cnt_stop(&cnt);
+		pwr_end(pw);
+		cnt_add(counts, &cnt);
+		total+=samples[s];
+		*jumps += part;
+		if (adapt_enabled())
+			more=adapt_more(ad, samples[s]/part) && s+1<ADAPT_MAX_RUNS;
+		else
+			more=s+1<LATENCY_SAMPLES;
+	}
+	*nsamples=s;
+	cnt_close(&cnt);
+	return 1000000000*total/((double) *jumps);
+}
+/* finishes the output line of a latency of chase() in ns with its cycles and frequency, and appends them to params */
+static void print_cycles(double latency, const pwr_t *pw, char *params, size_t size) {
+	size_t len=strlen(params);
+	if (!pwr_enabled())
+		return;
+	printf ("\tCycles:\t%.1f", latency*pwr_hz(pw)*1.0e-9);
+	pwr_print(pw, 0, NULL);
+	if (len<size)
+		snprintf(params+len, size-len, "%scycles=%.1f", len ? ";" : "", latency*pwr_hz(pw)*1.0e-9);
+	pwr_params(params, size, pw, 0, NULL);
+}
+/* writes the record of one latency in ns with the counters per jump, see result.h */
+static void emit(const char *mode, double latency, const double *samples, int nsamples, int threads, long size, void *mem, const char *params, const double *counts, double jumps) {
+	char buf[512];
+	result_t r={"latency", mode, "ns", latency, samples, nsamples, threads, size, mem ? mem_kind_name(mem_kind_of(mem)) : NULL, buf, mem ? mem_page_of(mem) : NULL};
+	snprintf(buf, sizeof(buf), "%s", params ? params : "");
+	if (counts!=NULL)
+		cnt_params(buf, sizeof(buf), counts, jumps, "jump");
+	result_emit(&r);
+}
+
 void bi_cleanup(void *mcb){
-  free(mcb);
+  mem_free(mcb);
   return;
 }
 typedef struct 
@@ -147,8 +280,15 @@ typedef struct
 	int threads;
 	int *pos;
 	long size;
+	long min_size;
+	long batch;							//jumps between two time stamps of the histogram mode
+	int chains;							//largest number of chains per thread of the mlp mode
+	double *matrix;
+	double *counts;						//PHI_COUNTERS of every matrix cell, CNT_MAX_EVENTS each
+	double *times;						//seconds of every thread for every chain count of the mlp mode or contention point of the coherence mode
+	uint64_t *stamps;					//TSC at the exit of every barrier of the barrier mode, threads per episode
 	double time;
-	pthread_barrier_t *barrier;
+	barrier_t *barrier;
 }argc_t;
 /* 
 *	The function for each thread to measure the memory access latency
@@ -156,134 +296,1155 @@ typedef struct
 void *thread (void *parm)
 {
 	argc_t *arg=(argc_t*)parm;
-	double results[2];
+	double results[2], samples[ADAPT_MAX_RUNS], counts[CNT_MAX_EVENTS];
 	numjumps=MEMORY_NUMBER_OF_JUMPS;
-	d_bi_start_sec = (double) ((long long) bi_gettimeofday());
 	
-	double start, stop;
-	int i;
+	int nsamples;
+	char params[128]="";
+	adapt_t ad;
+	pwr_t pw;
 
-	long length;
-	void *ptr;
+	long length, nodes, jumps;
 	
-	length = MEMORY_MAX_ACCESS_LENGTH;
+	length = MEMORY_MAX_ACCESS_LENGTH*sizeof(double);
 
 	results[0]=(double) length;
 
-	make_linked_memory(arg->mem, length);						//generate the memory space residing in the memory
-	ptr = jump_around(arg->mem, numjumps);						//a pre-run
- 	start=mysecond();
-	ptr = jump_around(arg->mem, numjumps);						//conduct pointer chasing
-	stop=mysecond();
-	
-	results[1]=1000000000*(double)(stop-start)/((double)numjumps);
-	printf ("Average memory latency %f ns\n", results[1]);
-	
+	nodes=make_linked_memory(arg->mem, length);					//generate the memory space residing in the memory
+	if (!bi_cold)
+		jump_around(arg->mem, numjumps);					//a pre-run
+	results[1]=chase(arg->mem, nodes, numjumps, samples, &nsamples, counts, &jumps, &ad, &pw);	//conduct pointer chasing
+	printf ("Average memory latency %f ns", results[1]);
+	print_cycles(results[1], &pw, params, sizeof(params));
+	adapt_print(&ad);
+	cnt_print(counts, jumps, "jump");
+	printf ("\n");
+	adapt_params(params, sizeof(params), &ad);
+	emit("memory", results[1], samples, nsamples, 1, length, arg->mem, params, counts, jumps);
+	return NULL;
 }
 /* 
-*	The function for a thread to measure its access latency to the L2 cache of a remote core
-*	Only the local and remote threads are involved. The number of threads is two. 
+*	The function for a thread to measure the latency over a geometric range of working sets,
+*	from arg->min_size to arg->size bytes. All chains are built in the one allocation arg->mem,
+*	so the transitions between L1, L2, MCDRAM and DDR show up in a single run.
 */
-void *thread_remote_l2 (void *parm)
+void *thread_sweep (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	double latency, samples[ADAPT_MAX_RUNS], counts[CNT_MAX_EVENTS];
+	double factor=pow(2.0, 1.0/SWEEP_STEPS_PER_OCTAVE);
+	double bytes;
+	long length, nodes, last=0, jumps;
+	int nsamples;
+	char params[128];
+	adapt_t ad;
+	pwr_t pw;
+
+	numjumps=MEMORY_NUMBER_OF_JUMPS;
+	for (bytes=arg->min_size; bytes<=arg->size*1.0001; bytes*=factor)
+	{
+		length=((long) (bytes+0.5))/chain_stride*chain_stride;		//whole nodes in this working set
+		if (length<2*chain_stride || length==last)
+			continue;
+		last=length;
+		nodes=make_linked_memory(arg->mem, length);
+		if (!bi_cold)
+			jump_around(arg->mem, numjumps);						//a pre-run
+		latency=chase(arg->mem, nodes, numjumps, samples, &nsamples, counts, &jumps, &ad, &pw);	//conduct pointer chasing
+		printf ("Size:\t%ld bytes\tAverage latency %f ns", length, latency);
+		params[0]='\0';
+		print_cycles(latency, &pw, params, sizeof(params));
+		adapt_print(&ad);
+		cnt_print(counts, jumps, "jump");
+		printf ("\n");
+		adapt_params(params, sizeof(params), &ad);
+		emit("sweep", latency, samples, nsamples, 1, length, arg->mem, params, counts, jumps);
+		fflush(stdout);
+	}
+	return NULL;
+}
+static int by_cycles(const void *x, const void *y) {
+	double a=*(const double *)x, b=*(const double *)y;
+	return a<b ? -1 : a>b;
+}
+/* 
+*	The function for a thread to measure the distribution of the memory latency. The chain is
+*	chased in batches of arg->batch jumps and only the ends of the batches are time stamped,
+*	with the TSC after the last load of a batch has completed, so no timer call sits inside
+*	the chain of dependent loads. The cost of a time stamp is measured beforehand and
+*	subtracted from every batch. The latency per jump of the batches goes into a histogram of
+*	HISTOGRAM_STEPS_PER_OCTAVE logarithmic buckets per doubling, and its percentiles are
+*	printed in ns and TSC cycles.
+*/
+void *thread_histogram (void *parm)
+{
+	static const double percentiles[]={0.5, 0.9, 0.99, 0.999};
+	argc_t *arg=(argc_t*)parm;
+	long batch=arg->batch, batches=HISTOGRAM_JUMPS/arg->batch, hist[HISTOGRAM_BUCKETS];
+	long nodes, b, i;
+	uint64_t *stamps, t0, t1, overhead=~(uint64_t) 0;
+	double *cycles, sum=0, counts[CNT_MAX_EVENTS], ns_per_cycle=1.0e9/bi_tsc_hz, p;
+	char params[256];
+	void *ptr;
+	cnt_t cnt;
+	int k;
+
+	stamps=(uint64_t *) malloc((batches+1)*sizeof(uint64_t));
+	cycles=(double *) malloc(batches*sizeof(double));
+	if (stamps==NULL || cycles==NULL)
+	{
+		printf ("Cannot allocate %ld time stamps\n", batches);
+		exit(1);
+	}
+	memset(stamps, 0, (batches+1)*sizeof(uint64_t));				//no page faults while chasing
+	nodes=make_linked_memory(arg->mem, arg->size);
+	if (!bi_cold)
+		jump_around(arg->mem, nodes<100 ? 100 : nodes/100*100);	//a pre-run over the whole chain
+	for (i=0;i<1000;++i)
+	{
+		t0=bi_rdtsc_ordered();
+		t1=bi_rdtsc_ordered();
+		if (t1-t0<overhead)
+			overhead=t1-t0;
+	}
+
+	ptr=arg->mem;
+	if (bi_cold)
+	{
+		bi_flushRegion(arg->mem, nodes*chain_stride);
+		bi_flushTLB();
+	}
+	cnt_open(&cnt);
+	cnt_start(&cnt);
+	stamps[0]=bi_rdtsc_ordered();
+	for (b=0;b<batches;++b)
+	{
+		ptr=jump_batch(ptr, batch);									//conduct pointer chasing
+		stamps[b+1]=bi_rdtsc_ordered();
+	}
+	cnt_stop(&cnt);
+	memset(counts, 0, sizeof(counts));
+	cnt_add(counts, &cnt);
+	cnt_close(&cnt);
+
+	memset(hist, 0, sizeof(hist));
+	for (b=0;b<batches;++b)
+	{
+		cycles[b]=stamps[b+1]-stamps[b]>overhead ? (double) (stamps[b+1]-stamps[b]-overhead)/batch : 0;
+		sum+=cycles[b];
+		k = cycles[b]<1 ? 0 : (int) (log2(cycles[b])*HISTOGRAM_STEPS_PER_OCTAVE);
+		hist[k<HISTOGRAM_BUCKETS ? k : HISTOGRAM_BUCKETS-1]++;
+	}
+	qsort(cycles, batches, sizeof(double), by_cycles);
+
+	printf ("Size:\t%ld bytes\tBatch:\t%ld jumps\tTime stamp:\t%llu cycles\tAverage latency %f ns",
+		arg->size, batch, (unsigned long long) overhead, sum/batches*ns_per_cycle);
+	cnt_print(counts, (double) batches*batch, "jump");
+	printf ("\n");
+	snprintf (params, sizeof(params), "batch=%ld;overhead=%llu", batch, (unsigned long long) overhead);
+	for (k=0;k<(int) (sizeof(percentiles)/sizeof(double));++k)
+	{
+		p=cycles[(long) ceil(percentiles[k]*batches)-1];
+		printf ("p%g:\t%f ns\t%f cycles\n", 100*percentiles[k], p*ns_per_cycle, p);
+		snprintf (params+strlen(params), sizeof(params)-strlen(params), ";p%g=%g", 100*percentiles[k], p*ns_per_cycle);
+	}
+	//one line per non-empty bucket: its range in ns and the share of the batches in it
+	for (k=0;k<HISTOGRAM_BUCKETS;++k)
+		if (hist[k]>0)
+			printf ("Bucket:\t%10.2f - %10.2f ns\t%10ld batches\t%8.4f %%\n",
+				k==0 ? 0 : pow(2.0, (double) k/HISTOGRAM_STEPS_PER_OCTAVE)*ns_per_cycle,
+				pow(2.0, (double) (k+1)/HISTOGRAM_STEPS_PER_OCTAVE)*ns_per_cycle, hist[k], 100.0*hist[k]/batches);
+	emit("histogram", sum/batches*ns_per_cycle, NULL, 0, 1, arg->size, arg->mem, params, counts, (double) batches*batch);
+	free(stamps);
+	free(cycles);
+	return NULL;
+}
+/* Walks a chain and rewrites every node, so the lines end up modified in the
+*  caches of the calling core and every other copy is invalidated
+*  @mem, the chain
+*  @n, the number of nodes in the chain
+*/
+void own_chain(void *mem, long n) {
+	void * volatile *ptr=(void * volatile *) mem;
+	void **next;
+	long a;
+
+	for(a=0;a<n;a++){
+		next=(void **) *ptr;
+		*ptr=(void *) next;
+		ptr=(void * volatile *) next;
+	}
+}
+/* 
+*	The function for each thread of the core-to-core L2 latency matrix.
+*	Every thread builds one chain in its own L2 once. Then, driven by barriers, for each
+*	pair the owner of the chain (column) takes its lines back into its L2 and the reader
+*	(row) chases them exactly once around, so every hop is a transfer from the owner.
+*	The diagonal is the latency of the local L2.
+*/
+void *thread_matrix (void *parm)
 {
 	argc_t *arg=(argc_t*)parm;
-	double results[2],start,stop;
-	void *self, *remote;
 	int tid=arg->tid;
-	int i;
-	
-	make_linked_memory(arg->mem, arg->size);							//both thread generate data for their L2 caches
-	pthread_barrier_wait(arg->barrier);
-	
-	arg->ptr_per_core[tid]=arg->mem;									//update the global pointer directory
-	jump_around(arg->mem, arg->size);					//pre-run to load the memory into local caches	
-	self=arg->ptr_per_core[tid];										//udpate the pointer to its own memory sapce
-	
-	pthread_barrier_wait(arg->barrier);
-	
-	if (tid==0)
+	int n=arg->threads;
+	int reader, owner, i;
+	long nodes, jumps;
+	double stop;
+	cnt_t cnt;
+
+	cnt_open(&cnt);
+	nodes=make_linked_memory(arg->mem, arg->size);
+	jumps=nodes<100 ? 100 : nodes/100*100;						//one pass over the chain, jump_around() jumps in hundreds
+	arg->ptr_per_core[tid]=arg->mem;							//publish the chain in the global pointer directory
+	barrier_wait(arg->barrier, tid);
+
+	for (owner=0;owner<n;++owner)
 	{
-		for (i=0;i<arg->threads;++i)
+		for (reader=0;reader<n;++reader)
 		{
-			if (i!=tid && arg->ptr_per_core[i]!=NULL)
+			if (tid==owner)
+				own_chain(arg->mem, nodes);
+			barrier_wait(arg->barrier, tid);
+			if (tid==reader)
 			{
-				remote=arg->ptr_per_core[i];							//the local thread finds the remote thread, and update the remote ptr
-				break;
+				cnt_start(&cnt);
+				bi_startTimer();
+				jump_around(arg->ptr_per_core[owner], jumps);	//conducts pointer chasing
+				stop=bi_stopTimer();
+				cnt_stop(&cnt);
+				arg->matrix[reader*n+owner]=1000000000*stop/((double)jumps);
+				//the counts per jump of this cell
+				memset(&arg->counts[(reader*n+owner)*CNT_MAX_EVENTS], 0, CNT_MAX_EVENTS*sizeof(double));
+				cnt_add(&arg->counts[(reader*n+owner)*CNT_MAX_EVENTS], &cnt);
+				for (i=0;i<CNT_MAX_EVENTS;++i)
+					arg->counts[(reader*n+owner)*CNT_MAX_EVENTS+i]/=jumps;
 			}
+			barrier_wait(arg->barrier, tid);
 		}
-		
-		d_bi_start_sec = (double) ((long long) bi_gettimeofday());
-		numjumps=L2_CACHE_NUMBER_OF_JUMPS;								//a smaller number of jumps for jumps in L2 caches
-		
-		start=mysecond();
-		jump_around(remote, numjumps);									//conducts pointer chasing
-		stop=mysecond();
-		
-		results[1]=1000000000*(double)(stop-start)/((double)numjumps);
-		printf ("From %d to %d:\t", arg->pos[tid], arg->pos[i]);
-		printf ("L2 latency %f ns\n", results[1]);		
 	}
+	cnt_close(&cnt);
+	return NULL;
+}
+/* 
+*	Runs thread_matrix on the given CPUs and fills matrix[reader*n+owner] with latencies in ns,
+*	and counts[(reader*n+owner)*CNT_MAX_EVENTS+e] with the PHI_COUNTERS per jump
+*/
+int run_matrix (int *cpus, int n, long chain_size, double *matrix, double *counts)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	barrier_t barrier;
+	cpu_set_t set;
+	argc_t info[MAX_NUM_THREADS];
+	void *ptr_per_core[MAX_NUM_THREADS];
+	char *mem;
+	int tt;
+
+	mem=(char *) mem_alloc(n*chain_size, mem_kind_for("chain"));
+	if (mem==NULL)
+		return 1;
+	barrier_init(&barrier, n, -1);
+	for (tt=0;tt<n;++tt)
+	{
+		ptr_per_core[tt]=NULL;
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(cpus[tt], &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		info[tt].size=chain_size;
+		info[tt].mem=mem+tt*chain_size;							//a separate chain per thread
+		info[tt].ptr_per_core=ptr_per_core;
+		info[tt].matrix=matrix;
+		info[tt].counts=counts;
+		info[tt].tid=tt;
+		info[tt].threads=n;
+		info[tt].barrier=&barrier;
+		if (pthread_create(&tid[tt], &attr, thread_matrix, (void*) &info[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", cpus[tt]);
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (tt = 0 ; tt != n ; ++tt)
+	{
+		pthread_join(tid[tt], NULL);
+	}
+	barrier_destroy(&barrier);
+	mem_free(mem);
+	return 0;
+}
+/* prints a CSV matrix, row and column headers are the CPUs, NAN is an empty cell */
+static void print_matrix(const char *corner, const int *cpus, int n, const double *matrix) {
+	int r, o;
+
+	printf ("%s", corner);
+	for (o=0;o<n;++o)
+		printf (",%d", cpus[o]);
+	printf ("\n");
+	for (r=0;r<n;++r)
+	{
+		printf ("%d", cpus[r]);
+		for (o=0;o<n;++o)
+			if (isnan(matrix[r*n+o]))
+				printf (",");
+			else
+				printf (",%.2f", matrix[r*n+o]);
+		printf ("\n");
+	}
+}
+/* the tests of the coherence mode, each one a matrix */
+enum {COH_PINGPONG, COH_XADD, COH_CAS, COH_FALSE, COH_PADDED, COH_TESTS};
+static const char *coh_names[COH_TESTS]={"pingpong", "xadd", "cas", "false-sharing", "padded"};
+static const char *coh_units[COH_TESTS]={"ns per round trip", "ns per lock xadd", "ns per successful CAS", "ns per increment", "ns per increment"};
+typedef struct
+{
+	volatile long v[8];
+}__attribute__((aligned(64))) line_t;
+static line_t coh_line[MAX_NUM_THREADS];							//[0] is the shared line, the others pad the counters of the padded test
+static volatile int coh_stop __attribute__((aligned(64)));		//ends the contenders, in a line of its own
+/* 
+*	One side of a coherence test on coh_line. side 0 measures: it does ops round trips or
+*	operations and then sets coh_stop. Every other side contends until coh_stop: it answers the
+*	ping-pong, hammers the same atomic counter, or increments its own counter, which shares the
+*	line of side 0 for false sharing and has a line of its own when padded.
+*	Returns the number of operations done.
+*/
+static long coherence_side(int test, int side, long ops) {
+	volatile long *flag=&coh_line[0].v[0];
+	volatile long *mine = test==COH_PADDED ? &coh_line[side].v[0] : &coh_line[0].v[side%8];
+	long i=0, old;
+
+	switch (test)
+	{
+	case COH_PINGPONG:
+		//the flag goes odd on the ping of side 0 and even on the pong of side 1
+		if (side==0)
+			for (i=0;i<ops;++i)
+			{
+				*flag=2*i+1;
+				while (*flag!=2*i+2);
+			}
+		else
+			for (;!coh_stop;)
+				if ((old=*flag)&1)
+				{
+					*flag=old+1;
+					++i;
+				}
+		break;
+	case COH_XADD:
+		for (;side==0 ? i<ops : !coh_stop;++i)
+			__sync_fetch_and_add(flag, 1);
+		break;
+	case COH_CAS:
+		for (;side==0 ? i<ops : !coh_stop;++i)
+			do
+				old=*flag;
+			while (!__sync_bool_compare_and_swap(flag, old, old+1));
+		break;
+	default:
+		for (;side==0 ? i<ops : !coh_stop;++i)
+			(*mine)++;
+		break;
+	}
+	if (side==0)
+		coh_stop=1;
+	return i;
+}
+/* 
+*	The function for each thread of the coherence mode. Driven by barriers, every test runs for
+*	every pair of threads in turn: the row thread measures and the column thread contends, the
+*	diagonal is the row thread alone (no ping-pong). Then the first 2 to n threads do
+*	COHERENCE_OPS xadd and cas each on the same counter at once, each one timing itself.
+*/
+void *thread_coherence (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	int tid=arg->tid, n=arg->threads;
+	int test, row, col, k;
+	long cell, ops;
+	double stop;
+	cnt_t cnt;
+
+	cnt_open(&cnt);
+	for (test=0;test<COH_TESTS;++test)
+		for (row=0;row<n;++row)
+			for (col=0;col<n;++col)
+			{
+				cell=(test*n+row)*n+col;
+				if (tid==0)
+				{
+					memset((void *) coh_line, 0, sizeof(coh_line));
+					coh_stop=0;
+				}
+				barrier_wait(arg->barrier, tid);
+				if (tid==row && (row!=col || test!=COH_PINGPONG))
+				{
+					cnt_start(&cnt);
+					bi_startTimer();
+					ops=coherence_side(test, 0, COHERENCE_OPS);
+					stop=bi_stopTimer();
+					cnt_stop(&cnt);
+					arg->matrix[cell]=1000000000*stop/ops;
+					memset(&arg->counts[cell*CNT_MAX_EVENTS], 0, CNT_MAX_EVENTS*sizeof(double));
+					cnt_add(&arg->counts[cell*CNT_MAX_EVENTS], &cnt);
+					for (k=0;k<CNT_MAX_EVENTS;++k)
+						arg->counts[cell*CNT_MAX_EVENTS+k]/=ops;
+				}
+				else if (tid==row)
+					arg->matrix[cell]=NAN;
+				else if (tid==col)
+					coherence_side(test, 1, 0);
+				barrier_wait(arg->barrier, tid);
+			}
+	//contention: every one of the k threads does the same number of operations
+	for (test=COH_XADD;test<=COH_CAS;++test)
+		for (k=2;k<=n;++k)
+		{
+			if (tid==0)
+				coh_line[0].v[0]=0;
+			barrier_wait(arg->barrier, tid);
+			if (tid<k)
+			{
+				bi_startTimer();
+				coherence_side(test, 0, COHERENCE_OPS);
+				arg->times[((test-COH_XADD)*(n+1)+k)*n+tid]=bi_stopTimer();
+			}
+			barrier_wait(arg->barrier, tid);
+		}
+	cnt_close(&cnt);
+	return NULL;
+}
+/* 
+*	Coherence between the first n CPUs of the placement: the pair matrices of all tests in ns
+*	per operation of the row CPU, then the throughput of xadd and cas from 2 to n contenders.
+*/
+int run_coherence (int n)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	barrier_t barrier;
+	cpu_set_t set;
+	argc_t info[MAX_NUM_THREADS];
+	int cpus[MAX_NUM_THREADS];
+	double *matrix, *counts, *times, slowest[2];
+	int tt, test, r, o, k, i;
+
+	matrix=(double *) malloc(COH_TESTS*n*n*sizeof(double));
+	counts=(double *) malloc(COH_TESTS*n*n*CNT_MAX_EVENTS*sizeof(double));
+	times=(double *) malloc(2*(n+1)*n*sizeof(double));
+	if (matrix==NULL || counts==NULL || times==NULL)
+		return 1;
+	barrier_init(&barrier, n, -1);
+	for (tt=0;tt<n;++tt)
+	{
+		cpus[tt]=placement_cpu(tt);
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(cpus[tt], &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		info[tt].matrix=matrix;
+		info[tt].counts=counts;
+		info[tt].times=times;
+		info[tt].tid=tt;
+		info[tt].threads=n;
+		info[tt].barrier=&barrier;
+		if (pthread_create(&tid[tt], &attr, thread_coherence, (void*) &info[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", cpus[tt]);
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (tt = 0 ; tt != n ; ++tt)
+	{
+		pthread_join(tid[tt], NULL);
+	}
+	barrier_destroy(&barrier);
+
+	for (test=0;test<COH_TESTS;++test)
+	{
+		printf ("Test:\t%s\t%s\n", coh_names[test], coh_units[test]);
+		print_matrix ("cpu\\partner", cpus, n, &matrix[test*n*n]);
+	}
+	for (r=0;r<n && result_enabled();++r)
+		for (o=0;o<n;++o)
+			for (test=0;test<COH_TESTS;++test)
+			{
+				char params[64];
+				if (isnan(matrix[(test*n+r)*n+o]))
+					continue;
+				snprintf (params, sizeof(params), "cpu=%d;partner=%d", cpus[r], cpus[o]);
+				emit(coh_names[test], matrix[(test*n+r)*n+o], NULL, 0, r==o ? 1 : 2, 0, NULL, params, &counts[((test*n+r)*n+o)*CNT_MAX_EVENTS], 1);
+			}
+	for (k=2;k<=n;++k)
+	{
+		//the operations of all k threads over the time of the slowest one
+		for (test=0;test<2;++test)
+			for (slowest[test]=0, i=0;i<k;++i)
+				if (times[(test*(n+1)+k)*n+i]>slowest[test])
+					slowest[test]=times[(test*(n+1)+k)*n+i];
+		printf ("Contenders:\t%d\txadd (Mops/s):\t%f\tcas (Mops/s):\t%f\n", k, 1.0E-06*k*COHERENCE_OPS/slowest[0], 1.0E-06*k*COHERENCE_OPS/slowest[1]);
+		for (test=0;test<2 && result_enabled();++test)
+		{
+			char params[64];
+			result_t res={"latency", coh_names[COH_XADD+test], "Mops/s", 1.0E-06*k*COHERENCE_OPS/slowest[test], &times[(test*(n+1)+k)*n], k, k, 0, NULL, params, NULL};
+			snprintf (params, sizeof(params), "contenders=%d", k);
+			result_emit(&res);
+		}
+	}
+	free(matrix);
+	free(counts);
+	free(times);
+	return 0;
+}
+/* Conducts n rounds of pointer chasing on k independent chains, one jump of every chain per round */
+static void chase_chains(void **ptr[], int k, long n) {
+	long a;
+	int c;
+
+	for(a=0;a<n;a++)
+		for(c=0;c<k;c++)
+			ptr[c]=(void **) *ptr[c];
+}
+/* 
+*	The function for each thread of the mlp mode. Every thread builds a private chain and, for
+*	1 to arg->chains chains, chases that many independent chains through it at once, all
+*	threads started together by a barrier. The chains start nodes/k apart on the chain, so the
+*	loads of one round are independent and can be in flight at the same time.
+*/
+void *thread_mlp (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	int n=arg->threads, tid=arg->tid, k, c;
+	long nodes, cell;
+	void **ptr[MLP_MAX_CHAINS];
+	cnt_t cnt;
+
+	cnt_open_thread(&cnt, tid);									//the counts of the threads are summed up
+	nodes=make_linked_memory(arg->mem, arg->size);
+	jump_around(arg->mem, nodes<100 ? 100 : nodes/100*100);		//a pre-run over the whole chain
+	for (k=1;k<=arg->chains;++k)
+	{
+		cell=(k-1)*n+tid;
+		ptr[0]=(void **) arg->mem;
+		for (c=1;c<k;++c)
+			ptr[c]=(void **) jump_batch(ptr[c-1], nodes/k);
+		barrier_wait(arg->barrier, tid);
+		cnt_start(&cnt);
+		bi_startTimer();
+		chase_chains(ptr, k, MLP_JUMPS/k);						//conduct pointer chasing
+		arg->times[cell]=bi_stopTimer();
+		cnt_stop(&cnt);
+		memset(&arg->counts[cell*CNT_MAX_EVENTS], 0, CNT_MAX_EVENTS*sizeof(double));
+		cnt_add(&arg->counts[cell*CNT_MAX_EVENTS], &cnt);
+	}
+	cnt_close(&cnt);
+	return NULL;
+}
+/* 
+*	Memory-level parallelism: n threads on the first CPUs of the placement chase private chains
+*	of chain_size bytes at the same time with 1 to chains independent chains each. Prints the
+*	latency per jump and the loads per ns of all threads together for every number of chains.
+*/
+int run_mlp (int n, int chains, long chain_size)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	barrier_t barrier;
+	cpu_set_t set;
+	argc_t info[MAX_NUM_THREADS];
+	double *times, *counts, sum[CNT_MAX_EVENTS], latency, slowest, loads;
+	char *mem;
+	int tt, k, i;
+
+	mem=(char *) mem_alloc(n*chain_size, mem_kind_for("chain"));
+	times=(double *) malloc(chains*n*sizeof(double));
+	counts=(double *) malloc(chains*n*CNT_MAX_EVENTS*sizeof(double));
+	if (mem==NULL || times==NULL || counts==NULL)
+	{
+		mem_free(mem);
+		return 1;
+	}
+	printf ("Memory:\t%s\tPages:\t%s\tThreads:\t%d\tChain:\t%ld bytes\n", mem_kind_name(mem_kind_of(mem)), mem_page_of(mem), n, chain_size);
+	barrier_init(&barrier, n, -1);
+	for (tt=0;tt<n;++tt)
+	{
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(tt), &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		info[tt].size=chain_size;
+		info[tt].mem=mem+tt*chain_size;							//a private chain per thread, first touched by it
+		info[tt].times=times;
+		info[tt].counts=counts;
+		info[tt].chains=chains;
+		info[tt].tid=tt;
+		info[tt].threads=n;
+		info[tt].barrier=&barrier;
+		if (pthread_create(&tid[tt], &attr, thread_mlp, (void*) &info[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", placement_cpu(tt));
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (tt = 0 ; tt != n ; ++tt)
+	{
+		pthread_join(tid[tt], NULL);
+	}
+	barrier_destroy(&barrier);
+
+	for (k=1;k<=chains;++k)
+	{
+		//the loads of all threads over the time of the slowest one
+		latency=slowest=0;
+		memset(sum, 0, sizeof(sum));
+		for (tt=0;tt<n;++tt)
+		{
+			latency+=times[(k-1)*n+tt];
+			if (times[(k-1)*n+tt]>slowest)
+				slowest=times[(k-1)*n+tt];
+			for (i=0;i<CNT_MAX_EVENTS;++i)
+				sum[i]+=counts[((k-1)*n+tt)*CNT_MAX_EVENTS+i];
+		}
+		loads=(double) n*(MLP_JUMPS/k)*k;
+		latency=1000000000*latency/n/(MLP_JUMPS/k);
+		printf ("Chains:\t%d\tLatency per jump (ns):\t%f\tLoads per ns:\t%f", k, latency, loads/slowest*1.0e-9);
+		cnt_print(sum, loads, "jump");
+		printf ("\n");
+		if (result_enabled())
+		{
+			char params[512];
+			result_t r={"latency", "mlp", "loads/ns", loads/slowest*1.0e-9, &times[(k-1)*n], n, n, chain_size, mem_kind_name(mem_kind_of(mem)), params, mem_page_of(mem)};
+			snprintf (params, sizeof(params), "chains=%d;latency=%g", k, latency);
+			cnt_params(params, sizeof(params), sum, loads, "jump");
+			result_emit(&r);
+		}
+	}
+	free(times);
+	free(counts);
+	mem_free(mem);
+	return 0;
+}
+/* 
+*	The function for each thread of the barrier mode: BARRIER_EPISODES barriers back to back
+*	timed as a whole, then BARRIER_SKEW_EPISODES barriers with the TSC read right at the exit.
+*/
+void *thread_barrier (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	int tid=arg->tid, n=arg->threads;
+	long e;
+
+	barrier_wait(arg->barrier, tid);							//a pre-run, all threads are up
+	bi_startTimer();
+	for (e=0;e<BARRIER_EPISODES;++e)
+		barrier_wait(arg->barrier, tid);
+	arg->times[tid]=bi_stopTimer();
+	for (e=0;e<BARRIER_SKEW_EPISODES;++e)
+	{
+		barrier_wait(arg->barrier, tid);
+		arg->stamps[e*n+tid]=bi_rdtsc();
+	}
+	return NULL;
+}
+/* 
+*	The cost of every kind of barrier.h for a doubling number of threads on the first CPUs of
+*	the placement, up to n: the latency of one barrier and the skew between the first and the
+*	last thread to leave it.
+*/
+int run_barrier (int n)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	barrier_t barrier;
+	cpu_set_t set;
+	argc_t info[MAX_NUM_THREADS];
+	double times[MAX_NUM_THREADS], latency, skew, max_skew, ns_per_tick=1.0e9/bi_tsc_hz;
+	uint64_t *stamps, first, last;
+	int kind, threads, tt;
+	long e;
+
+	stamps=(uint64_t *) malloc(BARRIER_SKEW_EPISODES*n*sizeof(uint64_t));
+	if (stamps==NULL)
+		return 1;
+	for (kind=0;kind<BARRIER_KINDS;++kind)
+		for (threads=2;threads<=n;threads = threads<n && 2*threads>n ? n : 2*threads)
+		{
+			if (barrier_init(&barrier, threads, kind))
+				return 1;
+			for (tt=0;tt<threads;++tt)
+			{
+				pthread_attr_init(&attr);
+				CPU_ZERO(&set);
+				CPU_SET(placement_cpu(tt), &set);
+				pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+				info[tt].tid=tt;
+				info[tt].threads=threads;
+				info[tt].barrier=&barrier;
+				info[tt].times=times;
+				info[tt].stamps=stamps;
+				if (pthread_create(&tid[tt], &attr, thread_barrier, (void*) &info[tt])!=0)
+				{
+					printf ("Cannot start a thread on CPU %d\n", placement_cpu(tt));
+					exit(1);
+				}
+				pthread_attr_destroy(&attr);
+			}
+			for (tt = 0 ; tt != threads ; ++tt)
+			{
+				pthread_join(tid[tt], NULL);
+			}
+			barrier_destroy(&barrier);
+
+			for (latency=0, tt=0;tt<threads;++tt)
+				latency+=times[tt];
+			latency=1000000000*latency/threads/BARRIER_EPISODES;
+			for (skew=max_skew=0, e=0;e<BARRIER_SKEW_EPISODES;++e)
+			{
+				for (first=last=stamps[e*threads], tt=1;tt<threads;++tt)
+				{
+					if (stamps[e*threads+tt]<first)
+						first=stamps[e*threads+tt];
+					if (stamps[e*threads+tt]>last)
+						last=stamps[e*threads+tt];
+				}
+				skew+=(last-first)*ns_per_tick;
+				if ((last-first)*ns_per_tick>max_skew)
+					max_skew=(last-first)*ns_per_tick;
+			}
+			skew/=BARRIER_SKEW_EPISODES;
+			printf ("Barrier:\t%s\tThreads:\t%d\tLatency (ns):\t%f\tExit skew (ns):\tmean %f\tmax %f\n", barrier_name(kind), threads, latency, skew, max_skew);
+			if (result_enabled())
+			{
+				char params[128];
+				result_t r={"latency", "barrier", "ns", latency, times, threads, threads, 0, NULL, params, NULL};
+				snprintf (params, sizeof(params), "barrier=%s;skew=%g;max_skew=%g", barrier_name(kind), skew, max_skew);
+				result_emit(&r);
+			}
+			fflush(stdout);
+			if (threads==n)
+				break;
+		}
+	free(stamps);
+	return 0;
+}
+/* state shared by the chasing thread and the load threads of the loaded mode */
+volatile int load_stop;											//ends the streaming of the current point
+volatile int load_quit;											//ends the load threads
+volatile long load_delay;										//empty loop iterations after every chunk
+typedef struct 
+{
+	float *a, *b, *c;
+	long size;													//floats per array, a multiple of LOAD_CHUNK
+	int kernel;													//0 copy c=a, 1 triad a=b+s*c
+	volatile long bytes;										//bytes read and written so far
+	pthread_barrier_t *barrier;
+}__attribute__((aligned(64))) load_t;
+/* 
+*	The function for each load thread of the loaded mode. Between the two barriers of a point,
+*	it streams copy or triad over its arrays until load_stop is set, and after every chunk of
+*	LOAD_CHUNK floats it spins load_delay iterations, so a larger delay is a lighter load.
+*/
+void *thread_load (void *parm)
+{
+	load_t *arg=(load_t*)parm;
+	__m512 s=_mm512_set1_ps(3.0f);
+	long chunk_bytes=(arg->kernel ? 3 : 2)*LOAD_CHUNK*sizeof(float);
+	long i, j, d;
+
+	for (i=0;i<arg->size;++i)									//first touch by the streaming thread
+	{
+		arg->a[i]=1.0f;
+		arg->b[i]=2.0f;
+		arg->c[i]=0.0f;
+	}
+	for (;;)
+	{
+		pthread_barrier_wait(arg->barrier);						//start of a point
+		if (load_quit)
+			break;
+		for (i=0; !load_stop; i=(i+LOAD_CHUNK)%arg->size)
+		{
+			if (arg->kernel==0)
+				for (j=i;j<i+LOAD_CHUNK;j+=16)
+					_mm512_stream_ps (&arg->c[j], _mm512_load_ps(&arg->a[j]));
+			else
+				for (j=i;j<i+LOAD_CHUNK;j+=16)
+					_mm512_stream_ps (&arg->a[j], _mm512_fmadd_ps(s, _mm512_load_ps(&arg->c[j]), _mm512_load_ps(&arg->b[j])));
+			arg->bytes+=chunk_bytes;
+			for (d=0;d<load_delay;++d)
+				__asm__ __volatile__ ("");
+		}
+		pthread_barrier_wait(arg->barrier);						//end of a point
+	}
+	return NULL;
+}
+static long load_bytes(load_t *load, int n)
+{
+	long bytes=0;
+	int tt;
+	for (tt=0;tt<n;++tt)
+		bytes+=load[tt].bytes;
+	return bytes;
+}
+/* 
+*	Memory latency under load: the calling thread, pinned to the first CPU of the placement,
+*	chases a LOADED_CHAIN_SIZE chain while n load threads on the next CPUs of the placement
+*	stream copy or triad with each of the given delays. The first point is without load.
+*	Prints the bandwidth the load threads delivered while the chain was chased and the latency.
+*/
+int run_loaded (int n, int kernel, const long *delays, int points)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	pthread_barrier_t barrier;
+	cpu_set_t set;
+	static load_t load[MAX_NUM_THREADS];
+	float *arrays=NULL;
+	void *mem;
+	long jumps=MEMORY_NUMBER_OF_JUMPS, bytes;
+	long size;
+	double stop, counts[CNT_MAX_EVENTS];
+	cnt_t cnt;
+	int tt, p;
+
+	//PHI_LOAD_MB per array, or LOAD_TOTAL_SIZE over all arrays and at most LOAD_ARRAY_SIZE floats each
+	if (getenv("PHI_LOAD_MB"))
+		size=atol(getenv("PHI_LOAD_MB"))*1024*1024/sizeof(float);
+	else
+		size = n>0 && LOAD_TOTAL_SIZE/(3*n*sizeof(float))<LOAD_ARRAY_SIZE ? LOAD_TOTAL_SIZE/(3*n*sizeof(float)) : LOAD_ARRAY_SIZE;
+	size = size<LOAD_CHUNK ? LOAD_CHUNK : size/LOAD_CHUNK*LOAD_CHUNK;
+	mem=mem_alloc(LOADED_CHAIN_SIZE, mem_kind_for("chain"));
+	if (n>0)
+		arrays=(float *) mem_alloc(n*3*size*sizeof(float), mem_kind_for("load"));
+	if (mem==NULL || (n>0 && arrays==NULL))
+	{
+		mem_free(mem);
+		return 1;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(placement_cpu(0), &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);	//the chasing CPU
+	make_linked_memory(mem, LOADED_CHAIN_SIZE);
+	printf ("Memory:\t%s\tPages:\t%s\tLoad threads:\t%d\tKernel:\t%s\tLoad arrays:\t%ld bytes\n", mem_kind_name(mem_kind_of(mem)), mem_page_of(mem), n, kernel ? "triad" : "copy", size*(long)sizeof(float));
+	cnt_open(&cnt);
+
+	if (n==0)
+		points=0;												//only the unloaded point
+	load_stop=1;
+	load_quit=0;
+	pthread_barrier_init(&barrier, NULL, n+1);
+	for (tt=0;tt<n;++tt)
+	{
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(tt+1), &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		load[tt].a=arrays+(3*tt+0)*size;
+		load[tt].b=arrays+(3*tt+1)*size;
+		load[tt].c=arrays+(3*tt+2)*size;
+		load[tt].size=size;
+		load[tt].kernel=kernel;
+		load[tt].bytes=0;
+		load[tt].barrier=&barrier;
+		if (pthread_create(&tid[tt], &attr, thread_load, (void*) &load[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", placement_cpu(tt+1));
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (p=-1;p<points;++p)
+	{
+		load_delay = p<0 ? 0 : delays[p];
+		load_stop = p<0;
+		pthread_barrier_wait(&barrier);
+		jump_around(mem, jumps);								//a pre-run, also ramps the load up
+		bytes=load_bytes(load, n);
+		cnt_start(&cnt);
+		bi_startTimer();
+		jump_around(mem, jumps);								//conduct pointer chasing under load
+		stop=bi_stopTimer();
+		cnt_stop(&cnt);
+		bytes=load_bytes(load, n)-bytes;
+		load_stop=1;
+		pthread_barrier_wait(&barrier);
+		if (p<0)
+			printf ("Delay:\tnone\t");
+		else
+			printf ("Delay:\t%ld\t", delays[p]);
+		printf ("Load bandwidth (MB/s):\t%12.1f\tLatency (ns):\t%f", 1.0E-06*bytes/stop, 1000000000*stop/((double)jumps));
+		memset(counts, 0, sizeof(counts));
+		cnt_add(counts, &cnt);
+		cnt_print(counts, jumps, "jump");
+		printf ("\n");
+		if (result_enabled())
+		{
+			char params[128];
+			snprintf (params, sizeof(params), "delay=%ld;load_threads=%d;kernel=%s;load_size=%ld;load_bandwidth=%.1f", p<0 ? -1 : delays[p], p<0 ? 0 : n, kernel ? "triad" : "copy", size*(long)sizeof(float), 1.0E-06*bytes/stop);
+			emit("loaded", 1000000000*stop/((double)jumps), &stop, 1, n+1, LOADED_CHAIN_SIZE, mem, params, counts, jumps);
+		}
+		fflush(stdout);
+	}
+	load_quit=1;
+	pthread_barrier_wait(&barrier);
+	for (tt = 0 ; tt != n ; ++tt)
+	{
+		pthread_join(tid[tt], NULL);
+	}
+	pthread_barrier_destroy(&barrier);
+	cnt_close(&cnt);
+	mem_free(arrays);
+	mem_free(mem);
+	return 0;
 }
-#define MAX_NUM_THREADS 288
 int main (int argc, char **argv)
 {
 	int threads;
 	pthread_t tid[MAX_NUM_THREADS];
 	pthread_attr_t attr;
-	pthread_barrier_t barrier;
 	cpu_set_t set;
 	int i,tt;
+	if (argc<2)
+	{
+		printf ("Usage: %s [--cold] 1 | 2 <local cpu> <remote cpu> | sweep [min KB] [max KB] | histogram [chain KB] [batch] | mlp [threads] [chains] [chain KB] | coherence [cpus] | barrier [threads] | matrix [cpus] [chain KB] | loaded [load threads] [copy|triad] [delays...]\n", argv[0]);
+		return 1;
+	}
+	void *mem=NULL;
+	bi_timer_init();
+	placement_init();
+	mem_init();
+	result_init();
+	cnt_init();
+	adapt_init();
+	pwr_init();
+	argc=bi_cache_args(argc, argv);
+	if (argc<2 || (bi_cold && strcmp(argv[1], "1")!=0 && strcmp(argv[1], "sweep")!=0 && strcmp(argv[1], "histogram")!=0))
+	{
+		printf ("Usage: %s --cold 1 | sweep [min KB] [max KB] | histogram [chain KB] [batch]\n", argv[0]);
+		return 1;
+	}
 	threads=atoll(argv[1]);
-	void *mem;
+	if (getenv("PHI_STRIDE"))
+	{
+		//distance of the chain nodes: "line", "page" or a number of bytes
+		const char *stride=getenv("PHI_STRIDE");
+		chain_stride = strcmp(stride, "line")==0 ? 64 : strcmp(stride, "page")==0 ? sysconf(_SC_PAGESIZE) : atol(stride);
+		if (chain_stride<(long)sizeof(void *) || chain_stride%sizeof(void *))
+		{
+			printf ("PHI_STRIDE must be a multiple of %d bytes\n", (int)sizeof(void *));
+			return 1;
+		}
+	}
+	if (getenv("PHI_CHAIN_THREADS"))
+		chain_threads=atoi(getenv("PHI_CHAIN_THREADS"));
 	argc_t info[MAX_NUM_THREADS];
-	void *ptr_per_core[MAX_NUM_THREADS];
-	pthread_barrier_init(&barrier, NULL, threads);
 	
-	if (threads==1)
+	if (strcmp(argv[1], "sweep")==0)
+	{
+		//measure the latency over a range of working sets with one allocation
+		long min_size = argc>2 ? atol(argv[2])*1024 : SWEEP_MIN_SIZE;
+		long max_size = argc>3 ? atol(argv[3])*1024 : SWEEP_MAX_SIZE;
+		mem=mem_alloc(max_size, mem_kind_for("chain"));
+		if (mem==NULL || min_size<=0 || min_size>max_size)
+		{
+			printf ("Cannot sweep from %ld to %ld bytes\n", min_size, max_size);
+			mem_free (mem);
+			return 1;
+		}
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(0), &set);//pin the thread to the first core of the placement
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		info[0].mem=mem;
+		info[0].min_size=min_size;
+		info[0].size=max_size;
+		printf ("Pages:\t%s\tCache:\t%s\n", mem_page_of(mem), bi_cache_name());
+		pthread_create(&tid[0], &attr, thread_sweep, (void*) &info[0]);
+		pthread_join(tid[0], NULL);
+	}
+	else if (strcmp(argv[1], "histogram")==0)
+	{
+		//measure the distribution of the memory latency, time stamped every [batch] jumps
+		long size = argc>2 ? atol(argv[2])*1024 : HISTOGRAM_CHAIN_SIZE;
+		long batch = argc>3 ? atol(argv[3]) : HISTOGRAM_BATCH;
+		if (bi_tsc_hz==0)
+		{
+			printf ("The histogram mode needs the TSC timer\n");
+			return 1;
+		}
+		mem=mem_alloc(size, mem_kind_for("chain"));
+		if (mem==NULL || size<2*chain_stride || batch<1 || batch>HISTOGRAM_JUMPS)
+		{
+			printf ("Cannot chase a %ld byte chain in batches of %ld jumps\n", size, batch);
+			mem_free (mem);
+			return 1;
+		}
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(0), &set);//pin the thread to the first core of the placement
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		info[0].mem=mem;
+		info[0].size=size;
+		info[0].batch=batch;
+		printf ("Pages:\t%s\tCache:\t%s\n", mem_page_of(mem), bi_cache_name());
+		pthread_create(&tid[0], &attr, thread_histogram, (void*) &info[0]);
+		pthread_join(tid[0], NULL);
+	}
+	else if (strcmp(argv[1], "mlp")==0)
+	{
+		//measure the loads per ns of threads chasing 1 to [chains] independent chains each
+		int n = argc>2 ? atoi(argv[2]) : 1;
+		int chains = argc>3 ? atoi(argv[3]) : MLP_MAX_CHAINS;
+		long chain_size = argc>4 ? atol(argv[4])*1024 : MLP_CHAIN_SIZE;
+		if (n<1 || n>MAX_NUM_THREADS || chains<1 || chains>MLP_MAX_CHAINS || chain_size<100*chain_stride*chains)
+		{
+			printf ("Usage: %s mlp [threads] [chains, 1 to %d] [chain KB]\n", argv[0], MLP_MAX_CHAINS);
+			return 1;
+		}
+		if (run_mlp(n, chains, chain_size))
+		{
+			printf ("Cannot allocate the chains\n");
+			return 1;
+		}
+	}
+	else if (strcmp(argv[1], "coherence")==0)
+	{
+		//cache line transfers between all pairs of CPUs of the placement, then contended atomics
+		int n = argc>2 ? atoi(argv[2]) : placement_cores();
+		if (n<2 || n>MAX_NUM_THREADS)
+		{
+			printf ("Cannot measure the coherence between %d CPUs\n", n);
+			return 1;
+		}
+		if (run_coherence(n))
+		{
+			printf ("Cannot allocate the matrices\n");
+			return 1;
+		}
+	}
+	else if (strcmp(argv[1], "barrier")==0)
+	{
+		//the latency and exit skew of every barrier kind from 2 to [threads] threads
+		int n = argc>2 ? atoi(argv[2]) : placement_count();
+		if (n<2 || n>MAX_NUM_THREADS || bi_tsc_hz==0)
+		{
+			printf ("Cannot measure barriers of %d threads without the TSC timer\n", n);
+			return 1;
+		}
+		if (run_barrier(n))
+		{
+			printf ("Cannot allocate the barriers\n");
+			return 1;
+		}
+	}
+	else if (strcmp(argv[1], "loaded")==0)
+	{
+		//measure the memory latency while other cores stream copy or triad at decreasing delays
+		static const long default_delays[]={10000, 3000, 1000, 300, 100, 30, 10, 3, 1, 0};
+		long delays[64];
+		int n = argc>2 ? atoi(argv[2]) : placement_count()-1;
+		int kernel = argc>3 && strcmp(argv[3], "triad")==0;
+		int points=0;
+		for (tt=4;tt<argc && points<64;++tt)
+			delays[points++]=atol(argv[tt]);
+		if (points==0)
+			for (;points<(int) (sizeof(default_delays)/sizeof(long));++points)
+				delays[points]=default_delays[points];
+		if (n<0 || n>=MAX_NUM_THREADS || (argc>3 && !kernel && strcmp(argv[3], "copy")!=0))
+		{
+			printf ("Usage: %s loaded [load threads] [copy|triad] [delays...]\n", argv[0]);
+			return 1;
+		}
+		if (run_loaded(n, kernel, delays, points))
+		{
+			printf ("Cannot allocate the chain and the load arrays\n");
+			return 1;
+		}
+	}
+	else if (threads==1)
 	{
 		//measure the memory latency of a single thread
-		mem=(void*)malloc(MEMORY_MAX_ACCESS_LENGTH*sizeof(double));
+		mem=mem_alloc(MEMORY_MAX_ACCESS_LENGTH*sizeof(double), mem_kind_for("chain"));
+		printf ("Pages:\t%s\tCache:\t%s\n", mem_page_of(mem), bi_cache_name());
 		pthread_attr_init(&attr);
 		CPU_ZERO(&set);
-		CPU_SET(threads, &set);//pin the thread to the coresponding core
+		CPU_SET(placement_cpu(0), &set);//pin the thread to the first core of the placement
 		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
 		info[0].mem=&mem[0*((MEMORY_MAX_ACCESS_LENGTH/threads)& ~15)];
 		pthread_create(&tid[0], &attr, thread, (void*) &info[0]);		
 		pthread_join(tid[0], NULL);
 	}
+	else if (strcmp(argv[1], "matrix")==0)
+	{
+		//measure the L2 latency between all pairs of CPUs of the placement in one process
+		int n = argc>2 ? atoi(argv[2]) : placement_cores();
+		long chain_size = argc>3 ? atol(argv[3])*1024 : MATRIX_CHAIN_SIZE;
+		int cpus[MAX_NUM_THREADS], r, o;
+		double *matrix, *counts;
+		if (n<1 || n>MAX_NUM_THREADS || chain_size<100*chain_stride)
+		{
+			printf ("Cannot measure a matrix of %d CPUs with %ld byte chains\n", n, chain_size);
+			return 1;
+		}
+		for (tt=0;tt<n;++tt)
+			cpus[tt]=placement_cpu(tt);
+		matrix=(double *) malloc(n*n*sizeof(double));
+		counts=(double *) malloc(n*n*CNT_MAX_EVENTS*sizeof(double));
+		if (matrix==NULL || counts==NULL || run_matrix(cpus, n, chain_size, matrix, counts))
+		{
+			printf ("Cannot allocate the chains\n");
+			return 1;
+		}
+		//CSV: row = reading CPU, column = CPU whose L2 holds the chain, latency in ns
+		print_matrix ("reader\\owner", cpus, n, matrix);
+		for (r=0;r<n && result_enabled();++r)
+			for (o=0;o<n;++o)
+			{
+				char params[64];
+				snprintf (params, sizeof(params), "reader=%d;owner=%d", cpus[r], cpus[o]);
+				emit("matrix", matrix[r*n+o], NULL, 0, n, chain_size, NULL, params, &counts[(r*n+o)*CNT_MAX_EVENTS], 1);
+			}
+		free (matrix);
+		free (counts);
+	}
 	else if (threads==2)
 	{
-		//measure the remote L2 access latency
-		threads=2;
+		//measure the remote L2 access latency between two CPUs
 		int pos[2];
+		double matrix[4], counts[4*CNT_MAX_EVENTS];
+		if (argc<4)
+		{
+			printf ("Usage: %s 2 <local cpu> <remote cpu>\n", argv[0]);
+			return 1;
+		}
 		//the location of the local thread
 		pos[0]=atoll(argv[2]);
 		//the location of the remote thread
 		pos[1]=atoll(argv[3]);
 		if (pos[1]==pos[0])
 			pos[1]=pos[0]-1;
-		mem=(void*)malloc(L2_CACHE_MAX_ACCESS_LENGTH*sizeof(double)*threads);
-		for (tt=0;tt<threads;++tt)
-		{
-			ptr_per_core[tt]=NULL;
-			pthread_attr_init(&attr);
-			CPU_ZERO(&set);
-			CPU_SET(pos[tt], &set);
-			info[tt].pos=pos;
-			pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
-			info[tt].size=L2_CACHE_MAX_ACCESS_LENGTH;
-			info[tt].mem=&mem[tt*info[tt].size];
-			info[tt].ptr_per_core=ptr_per_core;
-			info[tt].tid=tt;
-			info[tt].threads=threads;
-			info[tt].barrier=&barrier;
-			pthread_create(&tid[tt], &attr, thread_remote_l2, (void*) &info[tt]);		
-		}	
-		for (tt = 0 ; tt != threads ; ++tt)
+		if (run_matrix(pos, 2, MATRIX_CHAIN_SIZE, matrix, counts))
+			return 1;
+		printf ("From %d to %d:\t", pos[0], pos[1]);
+		printf ("L2 latency %f ns", matrix[0*2+1]);
+		cnt_print(&counts[(0*2+1)*CNT_MAX_EVENTS], 1, "jump");
+		printf ("\n");
+		if (result_enabled())
 		{
-			pthread_join(tid[tt], NULL);
+			char params[64];
+			snprintf (params, sizeof(params), "reader=%d;owner=%d", pos[0], pos[1]);
+			emit("remote", matrix[0*2+1], NULL, 0, 2, MATRIX_CHAIN_SIZE, NULL, params, &counts[(0*2+1)*CNT_MAX_EVENTS], 1);
 		}
 	}
-	free (mem);
+	else
+	{
+		printf ("Unknown mode \"%s\", more threads are measured by the mlp mode\n", argv[1]);
+		return 1;
+	}
+	mem_free (mem);
 	return 0;
 }
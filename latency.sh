@@ -1,8 +1,20 @@
 #./latency 1
 
-for i in $( seq 0 1 63); do
-	for j in $( seq 64 1 127); do
-		./latency 2 $i $j
-	done
-done
+# distribution of the memory latency with its p50/p90/p99/p99.9
+./latency histogram
 
+# memory-level parallelism: 1 to 16 independent chains on one core and on every core
+./latency mlp 1
+PHI_PLACEMENT=core ./latency mlp $(($1/4))
+
+# latency and exit skew of the barriers of barrier.h
+./latency barrier
+
+# core-to-core L2 latency matrix (CSV), one thread pinned to every core
+PHI_PLACEMENT=core ./latency matrix
+
+# cache line transfers between all pairs of cores and contended atomics (CSV matrices)
+PHI_PLACEMENT=core ./latency coherence
+
+# memory latency of one core while all other cores stream copy at decreasing delays
+PHI_PLACEMENT=core ./latency loaded
@@ -0,0 +1,335 @@
+/********************************************************************
+ * Memory allocation layer for latency.c and bandwidth.c
+ * See memory.h for the description of the page sizes.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "memory.h"
+
+#ifdef MCDRAM
+#include <memkind.h>
+#endif
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#define MAX_BLOCKS 64
+#define SIZE_4K (4096UL)
+#define SIZE_2M (2UL*1024*1024)
+#define SIZE_1G (1024UL*1024*1024)
+
+typedef struct
+{
+	void *ptr;				//what mem_alloc() returned
+	void *base;				//start of the mapping, for munmap
+	size_t length;			//length of the mapping
+	int kind;				//MEM_*, as actually used
+	int page;				//MEM_PAGE_*, as actually used
+}block_t;
+
+static block_t blocks[MAX_BLOCKS];
+static int requested_page=MEM_PAGE_4K;
+static int smallest_page=-1;						//smallest page size actually used, -1 before any allocation
+static const char *page_names[]={"4k", "thp", "2m", "1g"};
+static const char *kind_names[]={"DDR", "MCDRAM", "MCDRAM preferred", "MCDRAM interleave"};
+static const char *kind_keys[]={"ddr", "hbw", "hbw_preferred", "hbw_interleave"};
+static char node_names[MEM_MAX_NODES][16];
+static const char *memory_env=NULL;				//PHI_MEMORY, or the spec of mem_set_kinds()
+static char memory_spec[256];
+
+void mem_init(void)
+{
+	const char *env=getenv("PHI_PAGES");
+	int i;
+	memory_env=getenv("PHI_MEMORY");
+	requested_page=MEM_PAGE_4K;
+	if (env==NULL)
+		return;
+	for (i=0;i<4;++i)
+		if (strcmp(env, page_names[i])==0)
+			requested_page=i;
+	if (strcmp(env, page_names[requested_page])!=0)
+		fprintf(stderr, "PHI_PAGES: unknown page size \"%s\", using 4k\n", env);
+}
+
+void mem_set_kinds(const char *spec)
+{
+	if (spec==NULL)
+	{
+		memory_env=NULL;
+		return;
+	}
+	strncpy(memory_spec, spec, sizeof(memory_spec)-1);
+	memory_spec[sizeof(memory_spec)-1]='\0';
+	memory_env=memory_spec;
+}
+
+int mem_parse_kind(const char *name)
+{
+	int i;
+	if (strcmp(name, "default")==0)
+		return MEM_DDR;
+	for (i=0;i<4;++i)
+		if (strcmp(name, kind_keys[i])==0)
+			return i;
+	if (strncmp(name, "node:", 5)==0 && atoi(name+5)>=0 && atoi(name+5)<MEM_MAX_NODES)
+		return MEM_NODE+atoi(name+5);
+	return -1;
+}
+
+int mem_kind_for(const char *name)
+{
+	char buf[256], *item, *eq, *save=NULL;
+	int kind, all=-1, named=-1;
+#ifdef MCDRAM
+	int fallback=MEM_HBW;
+#else
+	int fallback=MEM_DDR;
+#endif
+	if (memory_env==NULL)
+		return fallback;
+	strncpy(buf, memory_env, sizeof(buf)-1);
+	buf[sizeof(buf)-1]='\0';
+	//a bare kind applies to all buffers, name=kind only to that buffer and takes precedence
+	for (item=strtok_r(buf, ",", &save); item!=NULL; item=strtok_r(NULL, ",", &save))
+	{
+		eq=strchr(item, '=');
+		if (eq!=NULL)
+			*eq='\0';
+		if (eq!=NULL && strcmp(item, name)!=0)
+			continue;
+		kind=mem_parse_kind(eq ? eq+1 : item);
+		if (kind<0)
+			fprintf(stderr, "PHI_MEMORY: unknown memory kind \"%s\"\n", eq ? eq+1 : item);
+		else if (eq!=NULL)
+			named=kind;
+		else
+			all=kind;
+	}
+	return named>=0 ? named : all>=0 ? all : fallback;
+}
+
+static size_t round_up(size_t size, size_t align)
+{
+	return (size+align-1) & ~(align-1);
+}
+
+/* anonymous mapping with regular pages; aligned to 2 MB and advised for THP if thp is set */
+static void *map_small(size_t size, int thp, block_t *blk)
+{
+	size_t align=thp ? SIZE_2M : SIZE_4K;
+	size_t length=round_up(size, align)+align;
+	char *base=mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	char *ptr;
+	if (base==MAP_FAILED)
+		return NULL;
+	ptr=(char *) round_up((uintptr_t) base, align);
+#ifdef MADV_HUGEPAGE
+	if (thp)
+		madvise(ptr, round_up(size, align), MADV_HUGEPAGE);
+#endif
+#ifdef MADV_NOHUGEPAGE
+	if (!thp)
+		madvise(base, length, MADV_NOHUGEPAGE);
+#endif
+	blk->base=base;
+	blk->length=length;
+	return ptr;
+}
+
+/* hugetlbfs mapping, NULL if no huge pages of that size are available */
+static void *map_huge(size_t size, int page, block_t *blk)
+{
+	size_t psize=page==MEM_PAGE_1G ? SIZE_1G : SIZE_2M;
+	int flags=MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(page==MEM_PAGE_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+	size_t length=round_up(size, psize);
+	void *base=mmap(NULL, length, PROT_READ|PROT_WRITE, flags, -1, 0);
+	if (base==MAP_FAILED)
+		return NULL;
+	blk->base=base;
+	blk->length=length;
+	return base;
+}
+
+static void *alloc_ddr(size_t size, int page, block_t *blk)
+{
+	void *ptr=NULL;
+	if (page==MEM_PAGE_2M || page==MEM_PAGE_1G)
+	{
+		ptr=map_huge(size, page, blk);
+		if (ptr==NULL)
+		{
+			fprintf(stderr, "No %s huge pages for %lu bytes, falling back to 4k pages\n", page_names[page], (unsigned long) size);
+			page=MEM_PAGE_4K;
+		}
+	}
+	if (ptr==NULL)
+		ptr=map_small(size, page==MEM_PAGE_THP, blk);
+	blk->page=page;
+	return ptr;
+}
+
+/* regular pages bound to one NUMA node (DDR, or MCDRAM in flat mode); bound before the first touch, so every page lands there */
+static void *alloc_node(size_t size, int node, int page, block_t *blk)
+{
+	unsigned long mask[(MEM_MAX_NODES+8*sizeof(unsigned long)-1)/(8*sizeof(unsigned long))]={0};
+	void *ptr=alloc_ddr(size, page, blk);
+	size_t length=(blk->page==MEM_PAGE_2M || blk->page==MEM_PAGE_1G) ? blk->length : round_up(size, SIZE_4K);
+	if (ptr==NULL)
+		return NULL;
+	mask[node/(8*sizeof(unsigned long))]|=1UL<<(node%(8*sizeof(unsigned long)));
+	if (syscall(SYS_mbind, ptr, length, MPOL_BIND, mask, MEM_MAX_NODES+1, 0)!=0)
+	{
+		fprintf(stderr, "Cannot bind memory to NUMA node %d, using the default policy\n", node);
+		blk->kind=MEM_DDR;
+	}
+	else
+		blk->kind=MEM_NODE+node;
+	return ptr;
+}
+
+#ifdef MCDRAM
+static void *alloc_hbw(size_t size, int hbw, int page, block_t *blk)
+{
+	memkind_t base=hbw==MEM_HBW_PREFERRED ? MEMKIND_HBW_PREFERRED : hbw==MEM_HBW_INTERLEAVE ? MEMKIND_HBW_INTERLEAVE : MEMKIND_HBW;
+	memkind_t kind=base;
+	void *ptr=NULL;
+
+	if (page==MEM_PAGE_2M && hbw!=MEM_HBW_INTERLEAVE)
+		kind=hbw==MEM_HBW_PREFERRED ? MEMKIND_HBW_PREFERRED_HUGETLB : MEMKIND_HBW_HUGETLB;
+	else if (page==MEM_PAGE_1G && hbw!=MEM_HBW_INTERLEAVE)
+		kind=hbw==MEM_HBW_PREFERRED ? MEMKIND_HBW_PREFERRED_GBTLB : MEMKIND_HBW_GBTLB;
+	if ((page==MEM_PAGE_2M || page==MEM_PAGE_1G) && (kind==base || memkind_check_available(kind)!=0))
+	{
+		fprintf(stderr, "No %s huge pages for %s, falling back to 4k pages\n", page_names[page], kind_names[hbw]);
+		kind=base;
+		page=MEM_PAGE_4K;
+	}
+	if (memkind_posix_memalign(kind, &ptr, SIZE_2M, size)!=0)
+		return NULL;
+#ifdef MADV_HUGEPAGE
+	if (page==MEM_PAGE_THP)
+		madvise(ptr, round_up(size, SIZE_2M), MADV_HUGEPAGE);
+#endif
+	blk->base=NULL;									//owned by memkind
+	blk->length=size;
+	blk->page=page;
+	blk->kind=hbw;
+	return ptr;
+}
+#endif
+
+void *mem_alloc(size_t size, int kind)
+{
+	block_t *blk=NULL;
+	void *ptr=NULL;
+	int i;
+
+	for (i=0;i<MAX_BLOCKS;++i)
+		if (blocks[i].ptr==NULL)
+		{
+			blk=&blocks[i];
+			break;
+		}
+	if (blk==NULL)
+		return NULL;
+	blk->kind=MEM_DDR;
+	if (kind>=MEM_NODE)
+		ptr=alloc_node(size, kind-MEM_NODE, requested_page, blk);
+	else if (kind!=MEM_DDR)
+	{
+#ifdef MCDRAM
+		if (kind==MEM_HBW_PREFERRED || memkind_check_available(MEMKIND_HBW)==0)
+			ptr=alloc_hbw(size, kind, requested_page, blk);
+		else
+			fprintf(stderr, "MCDRAM is not available, falling back to DDR\n");
+#else
+		fprintf(stderr, "%s needs a build with -DMCDRAM, falling back to DDR\n", kind_names[kind]);
+#endif
+	}
+	if (ptr==NULL)
+	{
+		blk->kind=MEM_DDR;
+		ptr=alloc_ddr(size, requested_page, blk);
+	}
+	if (ptr==NULL)
+		return NULL;
+	blk->ptr=ptr;
+	if (smallest_page<0 || blk->page<smallest_page)
+		smallest_page=blk->page;
+	return ptr;
+}
+
+static block_t *find_block(void *ptr)
+{
+	int i;
+	for (i=0;i<MAX_BLOCKS;++i)
+		if (ptr!=NULL && blocks[i].ptr==ptr)
+			return &blocks[i];
+	return NULL;
+}
+
+void mem_free(void *ptr)
+{
+	block_t *blk=find_block(ptr);
+	if (blk==NULL)
+		return;
+#ifdef MCDRAM
+	if (blk->kind>MEM_DDR && blk->kind<MEM_NODE)
+		memkind_free(NULL, ptr);					//memkind finds the kind itself
+	else
+#endif
+		munmap(blk->base, blk->length);
+	blk->ptr=NULL;
+}
+
+int mem_kind_of(void *ptr)
+{
+	block_t *blk=find_block(ptr);
+	return blk ? blk->kind : MEM_DDR;
+}
+
+const char *mem_page_of(void *ptr)
+{
+	block_t *blk=find_block(ptr);
+	return page_names[blk ? blk->page : requested_page];
+}
+
+const char *mem_page_name(void)
+{
+	return page_names[smallest_page<0 ? requested_page : smallest_page];
+}
+
+const char *mem_kind_name(int kind)
+{
+	if (kind>=MEM_NODE && kind<MEM_NODE+MEM_MAX_NODES)
+	{
+		snprintf(node_names[kind-MEM_NODE], sizeof(node_names[0]), "node %d", kind-MEM_NODE);
+		return node_names[kind-MEM_NODE];
+	}
+	return kind_names[kind>MEM_DDR && kind<MEM_NODE ? kind : 0];
+}
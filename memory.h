@@ -0,0 +1,93 @@
+/********************************************************************
+ * Memory allocation layer for latency.c and bandwidth.c
+ *
+ * Allocates benchmark buffers with a selectable page size, so TLB cost
+ * can be separated from memory cost. The page size is selected with the
+ * environment variable PHI_PAGES:
+ *   4k  - regular pages, transparent huge pages disabled (default)
+ *   thp - transparent huge pages through madvise(MADV_HUGEPAGE)
+ *   2m  - hugetlbfs pages of 2 MB (MAP_HUGETLB, MEMKIND_HBW_HUGETLB)
+ *   1g  - hugetlbfs pages of 1 GB (MAP_HUGETLB, MEMKIND_HBW_GBTLB)
+ * If the requested pages cannot be had (e.g. no huge pages reserved), the
+ * allocation falls back to 4k pages with a warning; mem_page_name()
+ * always reports the page size that was actually used.
+ *
+ * The memory kind of every buffer is selected at runtime with the
+ * environment variable PHI_MEMORY, either one kind for all buffers
+ * (PHI_MEMORY=hbw) or per buffer (PHI_MEMORY=a=ddr,b=hbw,c=node:1):
+ *   ddr            - default memory (MEMKIND_DEFAULT)
+ *   hbw            - MCDRAM (MEMKIND_HBW)
+ *   hbw_preferred  - MCDRAM while there is enough, DDR after (MEMKIND_HBW_PREFERRED)
+ *   hbw_interleave - interleaved over all MCDRAM nodes (MEMKIND_HBW_INTERLEAVE)
+ *   node:<n>       - bound to NUMA node n with mbind(), e.g. MCDRAM in flat mode
+ * The hbw kinds need memkind, i.e. a build with -DMCDRAM, and fall back
+ * to DDR with a warning otherwise.
+ *******************************************************************/
+
+#ifndef PHI_MEMORY_H
+#define PHI_MEMORY_H
+
+#include <stddef.h>
+
+/*!@brief Memory kinds for mem_alloc() */
+enum {
+	MEM_DDR = 0,		/**< default memory */
+	MEM_HBW,			/**< MCDRAM through memkind, only in builds with -DMCDRAM */
+	MEM_HBW_PREFERRED,	/**< MCDRAM if available, DDR otherwise, only with -DMCDRAM */
+	MEM_HBW_INTERLEAVE,	/**< MCDRAM interleaved over its nodes, only with -DMCDRAM */
+	MEM_NODE,			/**< MEM_NODE+n is bound to NUMA node n */
+};
+
+#define MEM_MAX_NODES 64
+
+/*!@brief Page sizes, see PHI_PAGES */
+enum {
+	MEM_PAGE_4K = 0, MEM_PAGE_THP, MEM_PAGE_2M, MEM_PAGE_1G,
+};
+
+/*!@brief Reads PHI_PAGES and PHI_MEMORY. Has to be called once before mem_alloc(). */
+void mem_init(void);
+
+/*!@brief Replaces the PHI_MEMORY setting for the following allocations;
+ *        spec has the same syntax, NULL restores the defaults.
+ */
+void mem_set_kinds(const char *spec);
+
+/*!@brief Parses a kind name of PHI_MEMORY, e.g. "hbw" or "node:1".
+ * @return The kind, -1 if the name is unknown.
+ */
+int mem_parse_kind(const char *name);
+
+/*!@brief The kind PHI_MEMORY selects for the buffer called name (e.g. "a").
+ *
+ * Buffers that PHI_MEMORY does not name get MEM_HBW in builds with
+ * -DMCDRAM and MEM_DDR otherwise, as before PHI_MEMORY existed.
+ */
+int mem_kind_for(const char *name);
+
+/*!@brief Allocates size bytes, aligned to at least 64 bytes.
+ *
+ * Kind MEM_HBW falls back to MEM_DDR if no high bandwidth memory is
+ * available or the code is built without -DMCDRAM.
+ * @return The memory, NULL on failure.
+ */
+void *mem_alloc(size_t size, int kind);
+
+/*!@brief Frees memory returned by mem_alloc(). */
+void mem_free(void *ptr);
+
+/*!@brief The kind that was actually used for ptr, e.g. MEM_DDR after a failed MEM_HBW request. */
+int mem_kind_of(void *ptr);
+
+/*!@brief Name of the page size that was actually used for ptr, "4k", "thp", "2m" or "1g" */
+const char *mem_page_of(void *ptr);
+
+/*!@brief Name of the requested page size, or of the smallest one actually
+ *        used if any allocation had to fall back.
+ */
+const char *mem_page_name(void);
+
+/*!@brief Name of a memory kind, e.g. "DDR" or "node 1" */
+const char *mem_kind_name(int kind);
+
+#endif
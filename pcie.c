@@ -0,0 +1,419 @@
+/********************************************************************
+ * PCIe transfers between the host and KNC cards over SCIF
+ *
+ * One source for both sides: built with -DPCIE_AGENT (-mmic) it is the
+ * agent that runs on every card, listens on SCIF port PCIE_PORT and
+ * serves the host, otherwise it is the benchmark on the host. For every
+ * card the host opens two connections, registers a buffer of [max KB]
+ * on each end, and moves data with scif_writeto() (host to card) and
+ * scif_readfrom() (card to host), which are DMA transfers of the card
+ * that complete synchronously with SCIF_RMA_SYNC.
+ *
+ * Every size from [min KB] to [max KB], doubling, is transferred until
+ * PCIE_MIN_BYTES have been moved per stream and timed run; the best of
+ * NTIMES runs is reported in the format of bandwidth.c. The tests are
+ * host to card, card to host, and both ways at once (two streams per
+ * card), with one card and then with all cards at once. Before that,
+ * the small-message latency of every card is measured as half of a
+ * scif_send()/scif_recv() round trip.
+ *
+ * Usage: pcie-mic            on every card, e.g. ssh mic0 ./pcie-mic &
+ *        pcie [cards] [min KB] [max KB]   on the host (default all cards)
+ * The host buffers are placed by PHI_MEMORY (the buffer "host", see
+ * memory.h) with the page size of PHI_PAGES.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <scif.h>
+#ifndef PCIE_AGENT
+#include "timer.h"
+#include "placement.h"
+#include "memory.h"
+#include "result.h"
+#include "barrier.h"
+#endif
+
+#define PCIE_PORT 4040								//SCIF port of the agents
+#define PCIE_MAX_CARDS 8
+#define PCIE_PAGE 4096								//registered windows are whole pages
+#define PCIE_MIN_SIZE (4L*1024)						//default smallest transfer
+#define PCIE_MAX_SIZE (64L*1024*1024)				//default largest transfer and window size
+#define PCIE_MIN_BYTES (64L*1024*1024)				//bytes per stream and timed run
+#define PCIE_MAX_PING 4096							//largest message of the latency test
+#define PCIE_PINGS 10000							//round trips per timed run of the latency test
+#define NTIMES 5									//timed runs of every point, the best one is reported
+
+/* the requests of the host, answered by the agent */
+enum {PCIE_WINDOW, PCIE_PING, PCIE_ERROR};
+typedef struct
+{
+	int64_t op;
+	int64_t size;								//bytes of the window or of a message
+	int64_t count;								//round trips of PCIE_PING
+	int64_t offset;								//of the card's window, in the answer to PCIE_WINDOW
+}pcie_msg_t;
+
+static int send_msg (scif_epd_t epd, pcie_msg_t *msg)
+{
+	return scif_send(epd, msg, sizeof(*msg), SCIF_SEND_BLOCK)==(int) sizeof(*msg) ? 0 : -1;
+}
+static int recv_msg (scif_epd_t epd, pcie_msg_t *msg)
+{
+	return scif_recv(epd, msg, sizeof(*msg), SCIF_RECV_BLOCK)==(int) sizeof(*msg) ? 0 : -1;
+}
+
+#ifdef PCIE_AGENT
+/* serves one connection of the host until it is closed; closing unregisters the window */
+void *serve (void *parm)
+{
+	scif_epd_t epd=*(scif_epd_t *) parm;
+	pcie_msg_t msg;
+	char *buf=NULL, ping[PCIE_MAX_PING];
+	long i;
+
+	free(parm);
+	while (recv_msg(epd, &msg)==0)
+	{
+		if (msg.op==PCIE_WINDOW && buf==NULL && msg.size>0 && msg.size%PCIE_PAGE==0)
+		{
+			if (posix_memalign((void **) &buf, PCIE_PAGE, msg.size)!=0)
+				buf=NULL;
+			else
+				memset(buf, 0, msg.size);
+			msg.offset = buf ? scif_register(epd, buf, msg.size, 0, SCIF_PROT_READ|SCIF_PROT_WRITE, 0) : SCIF_REGISTER_FAILED;
+			if (msg.offset==SCIF_REGISTER_FAILED)
+				msg.op=PCIE_ERROR;
+			if (send_msg(epd, &msg)!=0 || msg.op==PCIE_ERROR)
+				break;
+		}
+		else if (msg.op==PCIE_PING && msg.size>0 && msg.size<=PCIE_MAX_PING)
+		{
+			//echo every message, the host times the round trips
+			for (i=0;i<msg.count;++i)
+				if (scif_recv(epd, ping, msg.size, SCIF_RECV_BLOCK)!=msg.size || scif_send(epd, ping, msg.size, SCIF_SEND_BLOCK)!=msg.size)
+					break;
+		}
+		else
+			break;
+	}
+	scif_close(epd);
+	free(buf);
+	return NULL;
+}
+
+int main (int argc, char **argv)
+{
+	struct scif_portID peer;
+	scif_epd_t listener, *epd;
+	pthread_t tid;
+
+	if ((listener=scif_open())==SCIF_OPEN_FAILED || scif_bind(listener, PCIE_PORT)<0 || scif_listen(listener, 2*PCIE_MAX_CARDS)<0)
+	{
+		printf ("Cannot listen on SCIF port %d\n", PCIE_PORT);
+		return 1;
+	}
+	printf ("Listening on SCIF port %d\n", PCIE_PORT);
+	fflush(stdout);
+	for (;;)
+	{
+		epd=(scif_epd_t *) malloc(sizeof(*epd));
+		if (epd==NULL || scif_accept(listener, &peer, epd, SCIF_ACCEPT_SYNC)<0)
+		{
+			free(epd);
+			continue;
+		}
+		if (pthread_create(&tid, NULL, serve, epd)!=0)
+		{
+			scif_close(*epd);
+			free(epd);
+			continue;
+		}
+		pthread_detach(tid);
+	}
+	return 0;
+}
+#else
+
+/* the tests, in the order they are run */
+enum {PCIE_H2C, PCIE_C2H, PCIE_BIDIR, PCIE_TESTS};
+static const char *test_name[PCIE_TESTS]={"h2c", "c2h", "bidir"};
+static const char *test_label[PCIE_TESTS]={"Host to card:", "Card to host:", "Both ways:   "};
+
+/* a connection to the agent of a card, with a registered window on both ends */
+typedef struct
+{
+	scif_epd_t epd;
+	char *buf;
+	off_t local, remote;
+}conn_t;
+
+static conn_t conn[PCIE_MAX_CARDS][2];			//two per card, for both ways at once
+static uint16_t node[PCIE_MAX_CARDS];			//SCIF node of every card
+
+typedef struct
+{
+	conn_t *conn;
+	int dir;									//PCIE_H2C or PCIE_C2H
+	int tid;
+	int nsizes;
+	const size_t *sizes, *reps;
+	double *time;								//[size*NTIMES+run]
+	int err;
+	barrier_t *barrier;
+}argc_t;
+
+/* connects to the agent of card c and registers a window of bytes on both ends; returns 0 or -1 */
+static int connect_card (conn_t *cn, int c, size_t bytes)
+{
+	struct scif_portID dst;
+	pcie_msg_t msg;
+
+	dst.node=node[c];
+	dst.port=PCIE_PORT;
+	cn->buf=NULL;
+	if ((cn->epd=scif_open())==SCIF_OPEN_FAILED || scif_connect(cn->epd, &dst)<0)
+	{
+		printf ("Cannot connect to SCIF node %d, is pcie-mic running on the card?\n", node[c]);
+		return -1;
+	}
+	cn->buf=(char *) mem_alloc(bytes, mem_kind_for("host"));
+	if (cn->buf==NULL)
+	{
+		printf ("Cannot allocate %lu bytes for card %d\n", (unsigned long) bytes, c);
+		return -1;
+	}
+	memset(cn->buf, 1, bytes);
+	if ((cn->local=scif_register(cn->epd, cn->buf, bytes, 0, SCIF_PROT_READ|SCIF_PROT_WRITE, 0))==SCIF_REGISTER_FAILED)
+	{
+		printf ("Cannot register %lu bytes for card %d\n", (unsigned long) bytes, c);
+		return -1;
+	}
+	msg.op=PCIE_WINDOW;
+	msg.size=bytes;
+	msg.count=msg.offset=0;
+	if (send_msg(cn->epd, &msg)!=0 || recv_msg(cn->epd, &msg)!=0 || msg.op!=PCIE_WINDOW)
+	{
+		printf ("The agent on SCIF node %d cannot register %lu bytes\n", node[c], (unsigned long) bytes);
+		return -1;
+	}
+	cn->remote=msg.offset;
+	return 0;
+}
+static void disconnect_card (conn_t *cn, size_t bytes)
+{
+	if (cn->epd==SCIF_OPEN_FAILED)
+		return;
+	if (cn->buf!=NULL)
+		scif_unregister(cn->epd, cn->local, bytes);
+	scif_close(cn->epd);
+	mem_free(cn->buf);
+	cn->epd=SCIF_OPEN_FAILED;
+}
+
+/*
+ *	The function of each stream: for every size, NTIMES timed runs of reps DMA
+ *	transfers between two barriers. A failed transfer ends the runs of the size.
+ */
+void *thread (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	conn_t *cn=arg->conn;
+	double start;
+	size_t r;
+	int si, k;
+
+	for (si=0;si<arg->nsizes;++si)
+		for (k=0;k<NTIMES;++k)
+		{
+			barrier_wait(arg->barrier, arg->tid);
+			start=bi_gettime();
+			for (r=0;r<arg->reps[si] && !arg->err;++r)
+				if (arg->dir==PCIE_H2C)
+					arg->err=scif_writeto(cn->epd, cn->local, arg->sizes[si], cn->remote, SCIF_RMA_SYNC)<0;
+				else
+					arg->err=scif_readfrom(cn->epd, cn->local, arg->sizes[si], cn->remote, SCIF_RMA_SYNC)<0;
+			barrier_wait(arg->barrier, arg->tid);
+			arg->time[si*NTIMES+k]=bi_gettime()-start;
+		}
+	return NULL;
+}
+
+/* runs a test on the first cards cards at all sizes and prints the aggregate bandwidth; returns 0 or -1 */
+static int run_test (int test, int cards, int nsizes, const size_t *sizes, const size_t *reps)
+{
+	pthread_t tid[2*PCIE_MAX_CARDS];
+	pthread_attr_t attr;
+	cpu_set_t set;
+	barrier_t barrier;
+	argc_t info[2*PCIE_MAX_CARDS];
+	double samples[NTIMES], best, bytes;
+	int streams = test==PCIE_BIDIR ? 2*cards : cards, si, k, tt, err=0;
+
+	if (barrier_init(&barrier, streams, -1)!=0)
+		return -1;
+	for (tt=0;tt<streams;++tt)
+	{
+		//both ways: an even and an odd stream per card, each on its own connection
+		info[tt].conn = test==PCIE_BIDIR ? &conn[tt/2][tt%2] : &conn[tt][0];
+		info[tt].dir = test==PCIE_BIDIR ? (tt%2==0 ? PCIE_H2C : PCIE_C2H) : test;
+		info[tt].tid=tt;
+		info[tt].nsizes=nsizes;
+		info[tt].sizes=sizes;
+		info[tt].reps=reps;
+		info[tt].time=(double *) malloc(nsizes*NTIMES*sizeof(double));
+		info[tt].err=0;
+		info[tt].barrier=&barrier;
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(tt), &set);//pin the thread to the coresponding core
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		if (info[tt].time==NULL || pthread_create(&tid[tt], &attr, thread, (void*) &info[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", placement_cpu(tt));
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (tt=0;tt<streams;++tt)
+	{
+		pthread_join(tid[tt], NULL);
+		if (info[tt].err)
+		{
+			printf ("A transfer to or from SCIF node %d failed\n", node[test==PCIE_BIDIR ? tt/2 : tt]);
+			err=-1;
+		}
+	}
+	barrier_destroy(&barrier);
+	for (si=0;si<nsizes && err==0;++si)
+	{
+		//every run takes as long as its slowest stream
+		for (best=0, k=0;k<NTIMES;++k)
+		{
+			for (samples[k]=0, tt=0;tt<streams;++tt)
+				if (info[tt].time[si*NTIMES+k]>samples[k])
+					samples[k]=info[tt].time[si*NTIMES+k];
+			if (k==0 || samples[k]<best)
+				best=samples[k];
+		}
+		bytes=(double) streams*sizes[si]*reps[si];
+		printf ("Cards:\t%d\tSize:\t%lu bytes\tThreads:\t%d\t%sRead and write bandwidth (MB/s):\t%12.1f\n", cards, (unsigned long) sizes[si], streams, test_label[test], 1.0E-06*bytes/best);
+		if (result_enabled())
+		{
+			char params[128];
+			result_t r={"pcie", test_name[test], "MB/s", 1.0E-06*bytes/best, samples, NTIMES, streams, (long) sizes[si], mem_kind_name(mem_kind_of(conn[0][0].buf)), params, mem_page_of(conn[0][0].buf)};
+			snprintf (params, sizeof(params), "cards=%d;reps=%lu", cards, (unsigned long) reps[si]);
+			result_emit(&r);
+		}
+	}
+	for (tt=0;tt<streams;++tt)
+		free(info[tt].time);
+	fflush(stdout);
+	return err;
+}
+
+/* prints half the round trip of scif_send()/scif_recv() to card c for messages of 8 bytes to PCIE_MAX_PING; returns 0 or -1 */
+static int run_latency (int c)
+{
+	scif_epd_t epd=conn[c][0].epd;
+	pcie_msg_t msg;
+	char buf[PCIE_MAX_PING];
+	double samples[NTIMES], best=0, start;
+	int size, i, k;
+
+	memset(buf, 0, sizeof(buf));
+	for (size=8;size<=PCIE_MAX_PING;size*=2)
+	{
+		for (k=0;k<NTIMES;++k)
+		{
+			msg.op=PCIE_PING;
+			msg.size=size;
+			msg.count=PCIE_PINGS;
+			msg.offset=0;
+			if (send_msg(epd, &msg)!=0)
+				return -1;
+			start=bi_gettime();
+			for (i=0;i<PCIE_PINGS;++i)
+				if (scif_send(epd, buf, size, SCIF_SEND_BLOCK)!=size || scif_recv(epd, buf, size, SCIF_RECV_BLOCK)!=size)
+				{
+					printf ("A message to SCIF node %d failed\n", node[c]);
+					return -1;
+				}
+			samples[k]=(bi_gettime()-start)/PCIE_PINGS/2;
+			if (k==0 || samples[k]<best)
+				best=samples[k];
+		}
+		printf ("Card:\t%d\tSize:\t%d bytes\tLatency (us):\t%f\n", c, size, best*1.0E06);
+		if (result_enabled())
+		{
+			char params[128];
+			result_t r={"pcie", "latency", "us", best*1.0E06, samples, NTIMES, 1, size, NULL, params, NULL};
+			snprintf (params, sizeof(params), "card=%d;node=%d;pings=%d", c, node[c], PCIE_PINGS);
+			result_emit(&r);
+		}
+	}
+	fflush(stdout);
+	return 0;
+}
+
+int main (int argc, char **argv)
+{
+	uint16_t nodes[PCIE_MAX_CARDS+1], self;
+	size_t min_size, max_size, sizes[64], reps[64], s;
+	int cards=0, n, c, k, test, nsizes=0, err=0;
+
+	bi_timer_init();
+	placement_init();
+	mem_init();
+	result_init();
+	//the host is one of the SCIF nodes, the cards the others
+	n=scif_get_nodeIDs(nodes, PCIE_MAX_CARDS+1, &self);
+	for (c=0;c<n && c<PCIE_MAX_CARDS+1;++c)
+		if (nodes[c]!=self && cards<PCIE_MAX_CARDS)
+			node[cards++]=nodes[c];
+	if (argc>1 && atoi(argv[1])<cards)
+		cards=atoi(argv[1]);
+	min_size = argc>2 ? atol(argv[2])*1024 : PCIE_MIN_SIZE;
+	max_size = argc>3 ? atol(argv[3])*1024 : PCIE_MAX_SIZE;
+	if (cards<1 || min_size<1 || max_size<min_size)
+	{
+		printf ("Usage: %s [cards] [min KB] [max KB], with pcie-mic running on the cards (%d found)\n", argv[0], n>0 ? n-1 : 0);
+		return 1;
+	}
+	for (s=min_size;s<=max_size && nsizes<64;s*=2)
+	{
+		sizes[nsizes]=s;
+		reps[nsizes++]=(PCIE_MIN_BYTES+s-1)/s;
+	}
+	//the windows are whole pages
+	max_size=(max_size+PCIE_PAGE-1)/PCIE_PAGE*PCIE_PAGE;
+	for (c=0;c<cards;++c)
+		for (k=0;k<2;++k)
+			conn[c][k].epd=SCIF_OPEN_FAILED;
+	for (c=0;c<cards && err==0;++c)
+		for (k=0;k<2 && err==0;++k)
+			err=connect_card(&conn[c][k], c, max_size);
+	if (err==0)
+	{
+		printf ("Memory:\t%s\tPages:\t%s\tCards:\t%d\n", mem_kind_name(mem_kind_of(conn[0][0].buf)), mem_page_of(conn[0][0].buf), cards);
+		for (c=0;c<cards && err==0;++c)
+			err=run_latency(c);
+		//one card alone, then all cards at once
+		for (n=1;n<=cards && err==0;n = n<cards ? cards : n+1)
+			for (test=0;test<PCIE_TESTS && err==0;++test)
+				err=run_test(test, n, nsizes, sizes, reps);
+	}
+	for (c=0;c<cards;++c)
+		for (k=0;k<2;++k)
+			disconnect_card(&conn[c][k], max_size);
+	return err ? 1 : 0;
+}
+#endif
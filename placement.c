@@ -0,0 +1,292 @@
+/********************************************************************
+ * Topology-aware thread placement
+ * See placement.h for the description of the policies.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include "placement.h"
+
+#define MAX_CPUS 1024
+#ifndef SYSFS_CPU
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#endif
+
+typedef struct
+{
+	int cpu;				//logical CPU number
+	int package;			//physical_package_id
+	int core_id;			//core_id as reported by sysfs, unique within a package
+	int l2;					//lowest CPU sharing the L2 cache, -1 if unknown
+	int core;				//dense core index within the whole system
+	int tile;				//dense tile index, cores sharing one L2 are in the same tile
+	int rank;				//rank of the core within its tile
+	int smt;				//rank of this CPU among the threads of its core
+}cpu_info_t;
+
+static cpu_info_t topo[MAX_CPUS];
+static int ncpus, ncores, ntiles;
+static int order[MAX_CPUS];
+static int norder;
+static char policy[256];
+
+/* reads one integer from a sysfs file, -1 if it does not exist */
+static int read_int(const char *path)
+{
+	FILE *f=fopen(path, "r");
+	int v=-1;
+	if (f==NULL)
+		return -1;
+	if (fscanf(f, "%d", &v)!=1)
+		v=-1;
+	fclose(f);
+	return v;
+}
+
+int placement_parse_list(const char *str, int *cpus, int max)
+{
+	int n=0, lo, hi, i;
+	char *end;
+
+	while (*str && *str!='\n')
+	{
+		lo=strtol(str, &end, 10);
+		if (end==str)
+			return -1;
+		hi=lo;
+		str=end;
+		if (*str=='-')
+		{
+			hi=strtol(str+1, &end, 10);
+			if (end==str+1 || hi<lo)
+				return -1;
+			str=end;
+		}
+		for (i=lo;i<=hi && n<max;++i)
+			cpus[n++]=i;
+		if (*str==',')
+			++str;
+		else if (*str && *str!='\n')
+			return -1;
+	}
+	return n;
+}
+
+/* the lowest CPU sharing the L2 cache with cpu, or -1 if unknown */
+static int l2_leader(int cpu)
+{
+	char path[256], buf[1024];
+	int idx, cpus[MAX_CPUS], n;
+	FILE *f;
+
+	for (idx=0;idx<8;++idx)
+	{
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", cpu, idx);
+		if (read_int(path)!=2)
+			continue;
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+		if ((f=fopen(path, "r"))==NULL)
+			return -1;
+		n=fgets(buf, sizeof(buf), f) ? placement_parse_list(buf, cpus, MAX_CPUS) : -1;
+		fclose(f);
+		return n>0 ? cpus[0] : -1;
+	}
+	return -1;
+}
+
+static int by_core(const void *x, const void *y)
+{
+	const cpu_info_t *p=x, *q=y;
+	if (p->package!=q->package)
+		return p->package-q->package;
+	if (p->core_id!=q->core_id)
+		return p->core_id-q->core_id;
+	return p->cpu-q->cpu;
+}
+
+/* reads package, core and L2 sharing of every CPU this process may run on,
+ * then numbers cores and tiles densely in (package, core_id) order */
+static void read_topology(void)
+{
+	char path[256];
+	int cpu, i, j;
+	int tile_cores[MAX_CPUS];
+	cpu_set_t allowed;
+	long max=sysconf(_SC_NPROCESSORS_CONF);
+
+	if (max>MAX_CPUS)
+		max=MAX_CPUS;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)!=0)
+	{
+		CPU_ZERO(&allowed);
+		for (cpu=0;cpu<max;++cpu)
+			CPU_SET(cpu, &allowed);
+	}
+	ncpus=0;
+	for (cpu=0;cpu<max;++cpu)
+	{
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+		topo[ncpus].cpu=cpu;
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+		topo[ncpus].package=read_int(path);
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+		topo[ncpus].core_id=read_int(path);
+		if (topo[ncpus].core_id<0)
+			topo[ncpus].core_id=cpu;						//no topology: every CPU is a core
+		topo[ncpus].l2=l2_leader(cpu);
+		++ncpus;
+	}
+	qsort(topo, ncpus, sizeof(cpu_info_t), by_core);
+
+	ncores=ntiles=0;
+	for (i=0;i<ncpus;++i)
+	{
+		if (i>0 && topo[i].package==topo[i-1].package && topo[i].core_id==topo[i-1].core_id)
+		{
+			//another SMT thread of the previous core
+			topo[i].core=topo[i-1].core;
+			topo[i].tile=topo[i-1].tile;
+			topo[i].rank=topo[i-1].rank;
+			topo[i].smt=topo[i-1].smt+1;
+			continue;
+		}
+		topo[i].core=ncores++;
+		topo[i].smt=0;
+		//a new core: look for an earlier core in the same L2 domain
+		for (j=0;j<i;++j)
+			if (topo[i].l2>=0 && topo[j].l2==topo[i].l2)
+				break;
+		if (j<i)
+		{
+			topo[i].tile=topo[j].tile;
+			topo[i].rank=++tile_cores[topo[j].tile];
+		}
+		else
+		{
+			topo[i].tile=ntiles++;
+			topo[i].rank=0;
+			tile_cores[topo[i].tile]=0;
+		}
+	}
+}
+
+/* sort keys of the policies, most significant first */
+static int key_compact(const cpu_info_t *p, int k) { return k==0 ? p->tile : k==1 ? p->rank : p->smt; }
+static int key_scatter(const cpu_info_t *p, int k) { return k==0 ? p->smt : k==1 ? p->rank : p->tile; }
+static int (*sort_key)(const cpu_info_t *, int);
+
+static int by_policy(const void *x, const void *y)
+{
+	const cpu_info_t *p=&topo[*(const int *)x], *q=&topo[*(const int *)y];
+	int k;
+	for (k=0;k<3;++k)
+		if (sort_key(p, k)!=sort_key(q, k))
+			return sort_key(p, k)-sort_key(q, k);
+	return p->cpu-q->cpu;
+}
+
+/* builds the placement list from the topology entries accepted by the policy */
+static void build_order(int (*key)(const cpu_info_t *, int), int max_smt, int max_rank)
+{
+	int i;
+	norder=0;
+	for (i=0;i<ncpus;++i)
+		if (topo[i].smt<=max_smt && topo[i].rank<=max_rank)
+			order[norder++]=i;
+	sort_key=key;
+	qsort(order, norder, sizeof(int), by_policy);
+	for (i=0;i<norder;++i)
+		order[i]=topo[order[i]].cpu;
+}
+
+static int by_cpu(const void *x, const void *y)
+{
+	return *(const int *)x-*(const int *)y;
+}
+
+int placement_init(void)
+{
+	const char *env=getenv("PHI_PLACEMENT");
+
+	read_topology();
+	if (env==NULL)
+	{
+#ifdef SCATTER
+		env="scatter";
+#else
+		env="linear";
+#endif
+	}
+	return placement_set(env);
+}
+
+int placement_set(const char *env)
+{
+	int i;
+
+	strncpy(policy, env, sizeof(policy)-1);
+	policy[sizeof(policy)-1]='\0';
+	if (strcmp(env, "compact")==0)
+		build_order(key_compact, MAX_CPUS, MAX_CPUS);
+	else if (strcmp(env, "scatter")==0)
+		build_order(key_scatter, MAX_CPUS, MAX_CPUS);
+	else if (strcmp(env, "core")==0)
+		build_order(key_compact, 0, MAX_CPUS);
+	else if (strcmp(env, "tile")==0)
+		build_order(key_compact, 0, 0);
+	else if (strncmp(env, "list:", 5)==0)
+	{
+		norder=placement_parse_list(env+5, order, MAX_CPUS);
+		if (norder<=0)
+		{
+			fprintf(stderr, "PHI_PLACEMENT: invalid CPU list \"%s\"\n", env+5);
+			norder=0;
+		}
+	}
+	else
+	{
+		if (strcmp(env, "linear")!=0)
+			fprintf(stderr, "PHI_PLACEMENT: unknown policy \"%s\", using linear\n", env);
+		strcpy(policy, "linear");
+		for (i=0;i<ncpus;++i)
+			order[i]=topo[i].cpu;
+		norder=ncpus;
+		qsort(order, norder, sizeof(int), by_cpu);
+	}
+	return norder;
+}
+
+int placement_cpu(int tid)
+{
+	if (norder==0)
+		return tid;
+	return order[tid%norder];
+}
+
+int placement_count(void)
+{
+	return norder;
+}
+
+const char *placement_name(void)
+{
+	return policy;
+}
+
+int placement_cores(void)
+{
+	return ncores;
+}
+
+int placement_tiles(void)
+{
+	return ntiles;
+}
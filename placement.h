@@ -0,0 +1,56 @@
+/********************************************************************
+ * Topology-aware thread placement shared by fmadd.c, latency.c and
+ * bandwidth.c
+ *
+ * The core / SMT / tile (shared L2) topology is read from /sys at runtime
+ * and turned into an ordered list of logical CPUs; thread tid is pinned to
+ * entry tid of that list. The policy is selected with the environment
+ * variable PHI_PLACEMENT:
+ *   linear   - logical CPU tid, as numbered by the OS
+ *   compact  - fill all SMT threads of a core before moving to the next core
+ *   scatter  - one thread per core, spread across tiles first, then the
+ *              second SMT thread of every core, and so on
+ *   core     - only the first SMT thread of every core
+ *   tile     - only the first SMT thread of the first core of every tile
+ *   list:<l> - an explicit CPU list, e.g. list:1,5,9-12
+ * Without PHI_PLACEMENT the default is scatter if built with -DSCATTER,
+ * linear otherwise.
+ *******************************************************************/
+
+#ifndef PHI_PLACEMENT_H
+#define PHI_PLACEMENT_H
+
+/*!@brief Reads the topology and the placement policy. Has to be called once
+ *        in main() before placement_cpu().
+ * @return The number of CPUs in the placement list, 0 on error.
+ */
+int placement_init(void);
+
+/*!@brief Switches to another policy, given like PHI_PLACEMENT (e.g. "compact"),
+ *        without reading the topology again. Threads pinned before keep
+ *        their CPUs.
+ * @return The number of CPUs in the new placement list, 0 on error.
+ */
+int placement_set(const char *policy);
+
+/*!@brief Returns the logical CPU that thread tid has to be pinned to.
+ *        Thread ids beyond the length of the list wrap around.
+ */
+int placement_cpu(int tid);
+
+/*!@brief Number of CPUs in the placement list. */
+int placement_count(void);
+
+/*!@brief Name of the selected policy, e.g. "scatter". */
+const char *placement_name(void);
+
+/*!@brief Number of cores and tiles found in the topology. */
+int placement_cores(void);
+int placement_tiles(void);
+
+/*!@brief Parses a CPU list such as "0-3,8,10-11" into cpus.
+ * @return The number of CPUs stored (at most max), -1 on a syntax error.
+ */
+int placement_parse_list(const char *str, int *cpus, int max);
+
+#endif
@@ -0,0 +1,254 @@
+/********************************************************************
+ * Core frequency and power
+ * See power.h for the MSRs and the power sources.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "timer.h"
+#include "placement.h"
+#include "power.h"
+
+#ifndef SYSFS_RAPL
+#define SYSFS_RAPL "/sys/class/powercap"
+#endif
+#ifndef SYSFS_MICRAS
+#define SYSFS_MICRAS "/sys/class/micras/power"
+#endif
+
+#define MSR_MPERF 0xe7
+#define MSR_APERF 0xe8
+#define PWR_MAX_CPUS 1024
+#define PWR_MAX_DOMAINS 8
+
+enum {SOURCE_NONE, SOURCE_RAPL, SOURCE_MICRAS};
+
+static int enabled=1;
+static int msr_ok=1;							//cleared at the first MSR that cannot be read
+static int msr_fd[PWR_MAX_CPUS];				//-1 if not open yet
+static int source=SOURCE_NONE;
+static int rapl_fd[PWR_MAX_DOMAINS];			//energy_uj of the package domains
+static double rapl_range[PWR_MAX_DOMAINS];		//joules at which the counter wraps
+static int ndomains;
+
+/* reads one number from an open sysfs file, -1 on error */
+static double read_number(int fd)
+{
+	char buf[64];
+	ssize_t len=pread(fd, buf, sizeof(buf)-1, 0);
+	if (len<=0)
+		return -1;
+	buf[len]='\0';
+	return strtod(buf, NULL);
+}
+/* reads one number from the sysfs file path, -1 on error */
+static double read_file(const char *path)
+{
+	int fd=open(path, O_RDONLY);
+	double v;
+	if (fd<0)
+		return -1;
+	v=read_number(fd);
+	close(fd);
+	return v;
+}
+
+/* finds the package domains of RAPL, returns their number */
+static int rapl_open(void)
+{
+	char path[256], name[64];
+	int i, fd;
+	FILE *f;
+
+	for (i=0; ndomains<PWR_MAX_DOMAINS; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/intel-rapl:%d/name", SYSFS_RAPL, i);
+		if ((f=fopen(path, "r"))==NULL)
+			break;
+		if (fscanf(f, "%63s", name)!=1)
+			name[0]='\0';
+		fclose(f);
+		if (strncmp(name, "package", 7)!=0)
+			continue;
+		snprintf(path, sizeof(path), "%s/intel-rapl:%d/energy_uj", SYSFS_RAPL, i);
+		if ((fd=open(path, O_RDONLY))<0 || read_number(fd)<0)
+		{
+			fprintf(stderr, "PHI_POWER: cannot read %s: %s\n", path, strerror(errno));
+			if (fd>=0)
+				close(fd);
+			continue;
+		}
+		rapl_fd[ndomains]=fd;
+		snprintf(path, sizeof(path), "%s/intel-rapl:%d/max_energy_range_uj", SYSFS_RAPL, i);
+		rapl_range[ndomains++]=read_file(path)*1.0e-6;
+	}
+	return ndomains;
+}
+/* joules of all package domains, or watts of the SMC */
+static double energy(void)
+{
+	double sum=0;
+	int i;
+
+	if (source==SOURCE_MICRAS)
+		return read_file(SYSFS_MICRAS)*1.0e-6;		//the total power of the card in uW comes first
+	for (i=0;i<ndomains;++i)
+		sum+=read_number(rapl_fd[i])*1.0e-6;
+	return sum;
+}
+
+void pwr_init(void)
+{
+	const char *env=getenv("PHI_POWER");
+	int i;
+
+	for (i=0;i<PWR_MAX_CPUS;++i)
+		msr_fd[i]=-1;
+	if (env!=NULL && strcmp(env, "off")==0)
+	{
+		enabled=0;
+		return;
+	}
+	if (rapl_open()>0)
+		source=SOURCE_RAPL;
+	else if (read_file(SYSFS_MICRAS)>0)
+		source=SOURCE_MICRAS;
+}
+
+int pwr_enabled(void)
+{
+	return enabled;
+}
+
+/* reads an MSR of cpu into *value, returns 0 or -1 and then turns the MSRs off */
+static int read_msr(int cpu, uint32_t msr, uint64_t *value)
+{
+	char path[64];
+
+	if (!msr_ok || cpu<0 || cpu>=PWR_MAX_CPUS)
+		return -1;
+	if (msr_fd[cpu]<0)
+	{
+		snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
+		msr_fd[cpu]=open(path, O_RDONLY);
+	}
+	if (msr_fd[cpu]<0 || pread(msr_fd[cpu], value, sizeof(*value), msr)!=sizeof(*value))
+	{
+		fprintf(stderr, "PHI_POWER: cannot read the APERF/MPERF MSRs of CPU %d (%s), using %.3f GHz\n", cpu, strerror(errno), bi_cpu_freq());
+		msr_ok=0;
+		return -1;
+	}
+	return 0;
+}
+/* sums APERF and MPERF over the CPUs of threads threads, 0 if they cannot be read */
+static int read_perf(int threads, uint64_t *aperf, uint64_t *mperf)
+{
+	uint64_t a, m;
+	int tt;
+
+	*aperf=*mperf=0;
+	for (tt=0;tt<threads;++tt)
+	{
+		if (read_msr(placement_cpu(tt), MSR_APERF, &a)!=0 || read_msr(placement_cpu(tt), MSR_MPERF, &m)!=0)
+			return 0;
+		*aperf+=a;
+		*mperf+=m;
+	}
+	return 1;
+}
+
+void pwr_reset(pwr_t *p)
+{
+	memset(p, 0, sizeof(*p));
+}
+
+void pwr_begin(pwr_t *p, int threads)
+{
+	if (!enabled)
+		return;
+	p->threads=threads;
+	read_perf(threads, &p->aperf, &p->mperf);
+	if (source!=SOURCE_NONE)
+		p->energy=energy();
+	p->start=bi_gettime();
+}
+
+void pwr_end(pwr_t *p)
+{
+	double time, e;
+	uint64_t a, m;
+	int i;
+
+	if (!enabled)
+		return;
+	time=bi_gettime()-p->start;
+	p->seconds+=time;
+	if (source==SOURCE_MICRAS)
+		p->joules+=(p->energy+energy())/2*time;		//the average of the power at both ends
+	else if (source==SOURCE_RAPL)
+	{
+		e=energy()-p->energy;
+		for (i=0;i<ndomains && e<0;++i)
+			e+=rapl_range[i];							//a counter has wrapped
+		p->joules+=e;
+	}
+	if (read_perf(p->threads, &a, &m))
+	{
+		p->daperf+=(double) (a-p->aperf);
+		p->dmperf+=(double) (m-p->mperf);
+	}
+}
+
+double pwr_hz(const pwr_t *p)
+{
+	//MPERF counts at the TSC frequency
+	if (msr_ok && p->dmperf>0 && bi_tsc_hz>0)
+		return bi_tsc_hz*p->daperf/p->dmperf;
+	return bi_cpu_freq()*1.0e9;
+}
+
+double pwr_watts(const pwr_t *p)
+{
+	if (source==SOURCE_NONE || p->seconds<=0)
+		return 0;
+	return p->joules/p->seconds;
+}
+
+void pwr_print(const pwr_t *p, double rate, const char *unit)
+{
+	double watts=pwr_watts(p);
+
+	if (!enabled)
+		return;
+	printf("\tFrequency (GHz):\t%.3f", pwr_hz(p)*1.0e-9);
+	if (watts>0)
+	{
+		printf("\tPower (W):\t%.1f", watts);
+		if (rate>0)
+			printf("\t%s/W:\t%f", unit, rate/watts);
+	}
+}
+
+void pwr_params(char *buf, size_t size, const pwr_t *p, double rate, const char *unit)
+{
+	size_t len=strlen(buf);
+	double watts=pwr_watts(p);
+
+	if (!enabled || len>=size)
+		return;
+	len+=snprintf(buf+len, size-len, "%sghz=%.3f", len ? ";" : "", pwr_hz(p)*1.0e-9);
+	if (watts>0 && len<size)
+	{
+		len+=snprintf(buf+len, size-len, ";watts=%.1f", watts);
+		if (rate>0 && len<size)
+			snprintf(buf+len, size-len, ";%s/W=%g", unit, rate/watts);
+	}
+}
@@ -0,0 +1,72 @@
+/********************************************************************
+ * Core frequency and power around the timed regions
+ *
+ * pwr_begin() and pwr_end() are called around the timed regions of a
+ * result and add up, for the CPUs of its threads (placement_cpu(0) to
+ * placement_cpu(threads-1)):
+ *   - the APERF and MPERF MSRs from /dev/cpu/<cpu>/msr (msr module,
+ *     root), whose ratio times the TSC frequency is the effective clock
+ *     while the cores were not halted, with turbo and the lower AVX
+ *     clocks; where they cannot be read the clock is bi_cpu_freq()
+ *   - the energy of the package RAPL domains from
+ *     /sys/class/powercap/intel-rapl:<n>/energy_uj, or on a KNC card the
+ *     total power of the SMC in /sys/class/micras/power, read at both
+ *     ends of every region
+ * The benchmarks print the frequency, the latency in cycles or the
+ * FLOPs per cycle, and with a power source the power and the GFLOPS/W
+ * or GB/s/W. The environment variable PHI_POWER=off leaves out both.
+ * The MSRs and sources that cannot be read are reported once.
+ *******************************************************************/
+
+#ifndef PHI_POWER_H
+#define PHI_POWER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!@brief The frequency and energy of the timed regions of one result */
+typedef struct
+{
+	int threads;						/**< of the region since pwr_begin() */
+	double start;						/**< bi_gettime() of pwr_begin() */
+	uint64_t aperf, mperf;				/**< summed over the CPUs at pwr_begin() */
+	double energy;						/**< joules of RAPL, or watts of the SMC, at pwr_begin() */
+	double seconds;						/**< of all regions */
+	double joules;						/**< of all regions, 0 without a power source */
+	double daperf, dmperf;				/**< increments of all regions */
+}pwr_t;
+
+/*!@brief Reads PHI_POWER and looks for the MSRs and a power source. Has to be
+ *        called once in main() after placement_init().
+ */
+void pwr_init(void);
+
+/*!@brief Nonzero unless PHI_POWER=off. */
+int pwr_enabled(void);
+
+/*!@brief Clears the regions of p. */
+void pwr_reset(pwr_t *p);
+
+/*!@brief Starts a region of the CPUs of threads threads. */
+void pwr_begin(pwr_t *p, int threads);
+
+/*!@brief Ends the region of pwr_begin() and adds it to p. */
+void pwr_end(pwr_t *p);
+
+/*!@brief The effective core clock in Hz over the regions of p. */
+double pwr_hz(const pwr_t *p);
+
+/*!@brief The average power in W over the regions of p, 0 without a power source. */
+double pwr_watts(const pwr_t *p);
+
+/*!@brief Prints "\tFrequency (GHz):\t<f>" and with a power source "\tPower (W):\t<w>",
+ *        followed by "\t<unit>/W:\t<rate/w>" if rate is above 0. Nothing with PHI_POWER=off.
+ */
+void pwr_print(const pwr_t *p, double rate, const char *unit);
+
+/*!@brief Appends ";ghz=<f>", ";watts=<w>" and ";<unit>/W=<rate/w>" to buf like
+ *        pwr_print(), for the params of a result record.
+ */
+void pwr_params(char *buf, size_t size, const pwr_t *p, double rate, const char *unit);
+
+#endif
@@ -0,0 +1,226 @@
+/********************************************************************
+ * Machine-readable results
+ * See result.h for the formats.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include "result.h"
+#include "placement.h"
+#include "memory.h"
+#include "cache.h"
+
+#ifndef PHI_BUILD_FLAGS
+#define PHI_BUILD_FLAGS ""							//set by the Makefile
+#endif
+#ifdef __VERSION__
+#define PHI_COMPILER __VERSION__
+#else
+#define PHI_COMPILER "unknown"
+#endif
+
+#define MAX_SAMPLES 1024
+
+enum {RESULT_NONE, RESULT_CSV, RESULT_JSON};
+static int format=RESULT_NONE;
+static FILE *out;
+static char host[256], cpu[256], os[256], start[32];
+
+static const char *csv_header="benchmark,test,threads,size,memory,pages,cache,placement,params,unit,value,"
+	"samples,min,median,mean,max,stddev,compiler,flags,host,cpu,os,start";
+
+/* the model name of the first CPU in /proc/cpuinfo */
+static void read_cpu(void)
+{
+	char line[512], *colon;
+	FILE *f=fopen("/proc/cpuinfo", "r");
+	strcpy(cpu, "unknown");
+	if (f==NULL)
+		return;
+	while (fgets(line, sizeof(line), f)!=NULL)
+		if (strncmp(line, "model name", 10)==0 && (colon=strchr(line, ':'))!=NULL)
+		{
+			snprintf(cpu, sizeof(cpu), "%s", colon+2);
+			cpu[strcspn(cpu, "\n")]='\0';
+			break;
+		}
+	fclose(f);
+}
+
+static void close_results(void)
+{
+	if (out!=NULL && out!=stdout)
+		fclose(out);
+	out=NULL;
+}
+
+void result_init(void)
+{
+	const char *env=getenv("PHI_RESULTS");
+	const char *path;
+	struct utsname u;
+	time_t now=time(NULL);
+
+	if (env==NULL)
+		return;
+	if (strncmp(env, "csv:", 4)==0)
+		format=RESULT_CSV;
+	else if (strncmp(env, "json:", 5)==0)
+		format=RESULT_JSON;
+	else
+	{
+		fprintf(stderr, "PHI_RESULTS: expected csv:<file> or json:<file> instead of \"%s\"\n", env);
+		return;
+	}
+	path=strchr(env, ':')+1;
+	out = strcmp(path, "-")==0 ? stdout : fopen(path, "a");
+	if (out==NULL)
+	{
+		fprintf(stderr, "PHI_RESULTS: cannot open %s\n", path);
+		format=RESULT_NONE;
+		return;
+	}
+	//a CSV header only at the start of a file, appended runs share it
+	if (format==RESULT_CSV && (out==stdout || ftell(out)==0))
+		fprintf(out, "%s\n", csv_header);
+	atexit(close_results);
+
+	if (gethostname(host, sizeof(host))!=0)
+		strcpy(host, "unknown");
+	host[sizeof(host)-1]='\0';
+	read_cpu();
+	if (uname(&u)==0)
+		snprintf(os, sizeof(os), "%s %s %s", u.sysname, u.release, u.machine);
+	strftime(start, sizeof(start), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+}
+
+int result_enabled(void)
+{
+	return format!=RESULT_NONE;
+}
+
+static int by_value(const void *x, const void *y)
+{
+	double a=*(const double *)x, b=*(const double *)y;
+	return a<b ? -1 : a>b;
+}
+
+/* writes a string, quoted as CSV or JSON needs it */
+static void put_string(const char *s)
+{
+	if (s==NULL)
+		s="";
+	if (format==RESULT_CSV && strpbrk(s, ",\"\n")==NULL)
+	{
+		fputs(s, out);
+		return;
+	}
+	fputc('"', out);
+	for (;*s;++s)
+	{
+		if (*s=='"')
+			fputs(format==RESULT_CSV ? "\"\"" : "\\\"", out);
+		else if (*s=='\\' && format==RESULT_JSON)
+			fputs("\\\\", out);
+		else if ((unsigned char) *s<' ' && format==RESULT_JSON)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+/* writes the key of a JSON member, or the separator of a CSV field */
+static void put_key(const char *key, int first)
+{
+	if (format==RESULT_JSON)
+		fprintf(out, "%s\"%s\":", first ? "{" : ",", key);
+	else if (!first)
+		fputc(',', out);
+}
+static void put_number(const char *key, double v)
+{
+	put_key(key, 0);
+	if (isfinite(v))
+		fprintf(out, "%.9g", v);
+	else if (format==RESULT_JSON)
+		fputs("null", out);
+}
+
+void result_emit(const result_t *r)
+{
+	double sorted[MAX_SAMPLES], min=0, median=0, mean=0, max=0, var=0;
+	int n=r->samples!=NULL ? r->nsamples : 0, i;
+
+	if (format==RESULT_NONE)
+		return;
+	if (n>MAX_SAMPLES)
+		n=MAX_SAMPLES;
+	if (n>0)
+	{
+		memcpy(sorted, r->samples, n*sizeof(double));
+		qsort(sorted, n, sizeof(double), by_value);
+		min=sorted[0];
+		max=sorted[n-1];
+		median = n%2 ? sorted[n/2] : (sorted[n/2-1]+sorted[n/2])/2;
+		for (i=0;i<n;++i)
+			mean+=sorted[i];
+		mean/=n;
+		for (i=0;i<n;++i)
+			var+=(sorted[i]-mean)*(sorted[i]-mean);
+		var = n>1 ? var/(n-1) : 0;
+	}
+
+	put_key("benchmark", 1);
+	put_string(r->benchmark);
+	put_key("test", 0);
+	put_string(r->test);
+	put_number("threads", r->threads);
+	put_number("size", r->size);
+	put_key("memory", 0);
+	put_string(r->memory);
+	put_key("pages", 0);
+	put_string(r->memory==NULL ? NULL : r->pages!=NULL ? r->pages : mem_page_name());
+	put_key("cache", 0);
+	put_string(r->memory!=NULL ? bi_cache_name() : NULL);
+	put_key("placement", 0);
+	put_string(placement_name());
+	put_key("params", 0);
+	put_string(r->params);
+	put_key("unit", 0);
+	put_string(r->unit);
+	put_number("value", r->value);
+	//the samples are one field in CSV, separated by semicolons
+	put_key("samples", 0);
+	fputs(format==RESULT_JSON ? "[" : "", out);
+	for (i=0;i<n;++i)
+		fprintf(out, "%s%.9g", i==0 ? "" : format==RESULT_JSON ? "," : ";", r->samples[i]);
+	fputs(format==RESULT_JSON ? "]" : "", out);
+	put_number("min", n ? min : NAN);
+	put_number("median", n ? median : NAN);
+	put_number("mean", n ? mean : NAN);
+	put_number("max", n ? max : NAN);
+	put_number("stddev", n ? sqrt(var) : NAN);
+	put_key("compiler", 0);
+	put_string(PHI_COMPILER);
+	put_key("flags", 0);
+	put_string(PHI_BUILD_FLAGS);
+	put_key("host", 0);
+	put_string(host);
+	put_key("cpu", 0);
+	put_string(cpu);
+	put_key("os", 0);
+	put_string(os);
+	put_key("start", 0);
+	put_string(start);
+	fputs(format==RESULT_JSON ? "}\n" : "\n", out);
+	fflush(out);
+}
@@ -0,0 +1,45 @@
+/********************************************************************
+ * Machine-readable results shared by all benchmarks
+ *
+ * Besides their text output, the benchmarks write one record per
+ * measured point if the environment variable PHI_RESULTS is set:
+ *   csv:<file>  - CSV with a header line (written if the file is empty)
+ *   json:<file> - one JSON object per line
+ * The file is appended to, "-" is stdout. Every record holds the value
+ * that is printed, the time of every iteration behind it with their
+ * min/median/mean/max/stddev, the thread count, the placement policy,
+ * the memory kind, the page size, warm or cold caches, the compiler and its flags and the
+ * host, so runs can be compared and noisy ones found.
+ *******************************************************************/
+
+#ifndef PHI_RESULT_H
+#define PHI_RESULT_H
+
+/*!@brief One measured point */
+typedef struct
+{
+	const char *benchmark;		/**< e.g. "bandwidth" */
+	const char *test;			/**< the kernel or mode, e.g. "copy" */
+	const char *unit;			/**< unit of value, e.g. "MB/s" */
+	double value;				/**< the result as printed */
+	const double *samples;		/**< seconds of every iteration, NULL if there is only the value */
+	int nsamples;
+	int threads;
+	long size;					/**< bytes per array or of the working set, 0 if none */
+	const char *memory;			/**< memory kind, NULL if the benchmark has no buffers */
+	const char *params;			/**< further parameters as "key=value;...", NULL if none */
+	const char *pages;			/**< page size of the buffers as from mem_page_of(), NULL for mem_page_name() */
+}result_t;
+
+/*!@brief Reads PHI_RESULTS and opens the result file. Has to be called once
+ *        in main() after placement_init() and mem_init().
+ */
+void result_init(void);
+
+/*!@brief Writes one record, nothing if PHI_RESULTS is not set. */
+void result_emit(const result_t *r);
+
+/*!@brief Nonzero if records are written. */
+int result_enabled(void);
+
+#endif
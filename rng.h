@@ -0,0 +1,48 @@
+/********************************************************************
+ * Fast 64-bit pseudo random number generator (splitmix64)
+ *
+ * Shared by the chain builder of latency.c, the indices of gather and
+ * scatter in bandwidth.c and the random updates of gups.c. The state
+ * is explicit, so every thread can have its own stream without locking.
+ *******************************************************************/
+
+#ifndef PHI_RNG_H
+#define PHI_RNG_H
+
+#include <stdint.h>
+
+typedef struct
+{
+	uint64_t state;
+}rng_t;
+
+/*!@brief Seeds a generator; different seeds give independent streams. */
+static inline void rng_seed(rng_t *rng, uint64_t seed)
+{
+	rng->state=seed;
+}
+
+/*!@brief Returns the next 64-bit random number. */
+static inline uint64_t rng_next(rng_t *rng)
+{
+	uint64_t z=(rng->state+=0x9e3779b97f4a7c15ULL);
+	z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+	z=(z^(z>>27))*0x94d049bb133111ebULL;
+	return z^(z>>31);
+}
+
+/*!@brief Maps a random number x onto [0, max) without a division
+ *        (multiply-shift, bias below 2^-32 for max < 2^32).
+ */
+static inline uint64_t rng_scale(uint64_t x, uint64_t max)
+{
+	return (uint64_t) (((unsigned __int128) x*max)>>64);
+}
+
+/*!@brief Returns a random number in [0, max), see rng_scale(). */
+static inline uint64_t rng_below(rng_t *rng, uint64_t max)
+{
+	return rng_scale(rng_next(rng), max);
+}
+
+#endif
@@ -0,0 +1,224 @@
+/********************************************************************
+ * Empirical roofline: streams arrays like copy() of bandwidth.c,
+ * c[i]=f(a[i]), where f applies a tunable number of fused multiply-adds
+ * to every loaded element. Sweeping the number of FMAs goes from the
+ * memory bound (no FMA, a plain copy) to the compute bound, and the
+ * measured ridge point is where the two meet.
+ *
+ * Double precision: every element moves 16 bytes (one load, one
+ * streaming store) and does 2 flops per FMA, so k FMAs per element are
+ * an arithmetic intensity of k/8 flops/byte.
+ *
+ * Usage: roofline [threads] [MB per array]
+ * The arrays a and c are placed by PHI_MEMORY (see memory.h), in MCDRAM
+ * with -DMCDRAM and in DDR otherwise by default.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <immintrin.h>
+#include "timer.h"
+#include "placement.h"
+#include "memory.h"
+#include "result.h"
+
+#define MAX_NUM_THREADS 288
+#define ROOFLINE_ARRAY_SIZE (256L*1024*1024)		//default bytes per array
+#define ROOFLINE_MAX_FMAS 512						//largest number of FMAs per element, 64 flops/byte
+#define ROOFLINE_CHAINS 16							//independent FMA chains, enough for the two VPUs of a KNL core at 6 cycles each
+#define ROOFLINE_BLOCK (8*ROOFLINE_CHAINS)			//elements per iteration, one vector per chain
+#define NTIMES 5									//repetitions of every point, the best one is reported
+
+/* state shared by main and the threads */
+volatile int roof_fmas;							//FMAs per element of the current point
+volatile int roof_quit;							//ends the threads
+
+typedef struct
+{
+	double *a, *c;
+	long size;									//elements of this thread, a multiple of ROOFLINE_BLOCK
+	double start;								//bi_gettime() when the thread started the kernel
+	double stop;								//bi_gettime() when it finished
+	pthread_barrier_t *barrier;
+}argc_t;
+
+/* ROOF_ALL(op) expands to op(0) ... op(15), one for every chain */
+#define ROOF_ALL(op) op(0) op(1) op(2) op(3) op(4) op(5) op(6) op(7) \
+	op(8) op(9) op(10) op(11) op(12) op(13) op(14) op(15)
+#define ROOF_LOAD(j) __m512d x##j=_mm512_load_pd(&a[i+8*j]);
+#define ROOF_FMA(j) x##j=_mm512_fmadd_pd(x##j, s, t);
+#define ROOF_STORE(j) _mm512_stream_pd(&c[i+8*j], x##j);
+
+/*
+*	c[i]=f(a[i]) with roof_fmas dependent FMAs per element; the ROOFLINE_CHAINS vectors of a
+*	block are independent, so the FMAs of an element overlap the ones of the others and their
+*	loads, and one thread per core reaches the peak of both VPUs
+*/
+static void kernel (double *a, double *c, long size, int fmas)
+{
+	__m512d s=_mm512_set1_pd(0.999);
+	__m512d t=_mm512_set1_pd(0.001);
+	long i;
+	int k;
+
+	for (i=0;i<size;i+=ROOFLINE_BLOCK)
+	{
+		ROOF_ALL(ROOF_LOAD)
+		for (k=0;k<fmas;++k)
+		{
+			ROOF_ALL(ROOF_FMA)
+		}
+		ROOF_ALL(ROOF_STORE)
+	}
+}
+/*
+*	The function for each thread: touches its part of the arrays first, then runs the kernel
+*	once between every two barriers of main until roof_quit is set
+*/
+void *thread (void *parm)
+{
+	argc_t *arg=(argc_t*)parm;
+	long i;
+
+	for (i=0;i<arg->size;++i)
+	{
+		arg->a[i]=1.0;
+		arg->c[i]=0.0;
+	}
+	for (;;)
+	{
+		pthread_barrier_wait(arg->barrier);						//start of a run
+		if (roof_quit)
+			break;
+		arg->start=bi_gettime();
+		kernel(arg->a, arg->c, arg->size, roof_fmas);
+		arg->stop=bi_gettime();
+		pthread_barrier_wait(arg->barrier);						//end of a run
+	}
+	return NULL;
+}
+/* the span from the earliest start to the latest stop of the threads */
+static double span (argc_t *info, int threads)
+{
+	double first=info[0].start, last=info[0].stop;
+	int tt;
+	for (tt=1;tt<threads;++tt)
+	{
+		if (info[tt].start<first)
+			first=info[tt].start;
+		if (info[tt].stop>last)
+			last=info[tt].stop;
+	}
+	return last-first;
+}
+
+int main (int argc, char **argv)
+{
+	pthread_t tid[MAX_NUM_THREADS];
+	pthread_attr_t attr;
+	pthread_barrier_t barrier;
+	cpu_set_t set;
+	argc_t info[MAX_NUM_THREADS];
+	double *a, *c;
+	char pages[64];
+	double time, best, samples[NTIMES], flops, bytes, gflops, peak_flops=0, peak_bytes=0;
+	long n, size;
+	int threads, fmas, k, tt;
+
+	bi_timer_init();
+	placement_init();
+	mem_init();
+	result_init();
+	threads = argc>1 ? atoi(argv[1]) : placement_count();
+	n = (argc>2 ? atol(argv[2])*1024*1024 : ROOFLINE_ARRAY_SIZE)/sizeof(double);
+	if (threads<1 || threads>MAX_NUM_THREADS)
+	{
+		printf ("Usage: %s [threads] [MB per array], at most %d threads\n", argv[0], MAX_NUM_THREADS);
+		return 1;
+	}
+	size=n/threads/ROOFLINE_BLOCK*ROOFLINE_BLOCK;				//elements per thread
+	n=size*threads;
+	a=(double *) mem_alloc(n*sizeof(double), mem_kind_for("a"));
+	c=(double *) mem_alloc(n*sizeof(double), mem_kind_for("c"));
+	if (size==0 || a==NULL || c==NULL)
+	{
+		printf ("Cannot allocate two arrays of %ld elements\n", n);
+		return 1;
+	}
+	if (mem_kind_of(a)==mem_kind_of(c))
+		printf ("Memory:\t%s\t", mem_kind_name(mem_kind_of(a)));
+	else
+		printf ("Memory:\ta=%s,c=%s\t", mem_kind_name(mem_kind_of(a)), mem_kind_name(mem_kind_of(c)));
+	if (strcmp(mem_page_of(a), mem_page_of(c))==0)
+		snprintf (pages, sizeof(pages), "%s", mem_page_of(a));
+	else
+		snprintf (pages, sizeof(pages), "a=%s,c=%s", mem_page_of(a), mem_page_of(c));
+	printf ("Pages:\t%s\tThreads:\t%d\tArray size:\t%ld bytes\n", pages, threads, n*(long)sizeof(double));
+
+	roof_quit=0;
+	pthread_barrier_init(&barrier, NULL, threads+1);
+	for (tt=0;tt<threads;++tt)
+	{
+		info[tt].a=&a[size*tt];
+		info[tt].c=&c[size*tt];
+		info[tt].size=size;
+		info[tt].barrier=&barrier;
+		pthread_attr_init(&attr);
+		CPU_ZERO(&set);
+		CPU_SET(placement_cpu(tt), &set);//pin the thread to the coresponding core
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+		if (pthread_create(&tid[tt], &attr, thread, (void*) &info[tt])!=0)
+		{
+			printf ("Cannot start a thread on CPU %d\n", placement_cpu(tt));
+			return 1;
+		}
+		pthread_attr_destroy(&attr);
+	}
+	for (fmas=0;fmas<=ROOFLINE_MAX_FMAS;fmas=fmas ? 2*fmas : 1)
+	{
+		roof_fmas=fmas;
+		best=0;
+		for (k=0;k<NTIMES;++k)
+		{
+			pthread_barrier_wait(&barrier);
+			pthread_barrier_wait(&barrier);
+			time=samples[k]=span(info, threads);
+			if (k==0 || time<best)
+				best=time;
+		}
+		flops=2.0*fmas*n;
+		bytes=2.0*sizeof(double)*n;
+		gflops=flops/best/1000000000;
+		if (gflops>peak_flops)
+			peak_flops=gflops;
+		if (bytes/best>peak_bytes)
+			peak_bytes=bytes/best;
+		printf ("FMAs/element:\t%d\tIntensity (flops/byte):\t%f\tGFLOPS:\t%f\tBandwidth (MB/s):\t%12.1f\n", fmas, flops/bytes, gflops, 1.0E-06*bytes/best);
+		if (result_enabled())
+		{
+			char params[128];
+			result_t r={"roofline", "fmadd", "GFLOPS", gflops, samples, NTIMES, threads, n*(long)sizeof(double), mem_kind_name(mem_kind_of(a)), params, pages};
+			snprintf (params, sizeof(params), "fmas=%d;intensity=%f;bandwidth=%.1f", fmas, flops/bytes, 1.0E-06*bytes/best);
+			result_emit(&r);
+		}
+		fflush(stdout);
+	}
+	roof_quit=1;
+	pthread_barrier_wait(&barrier);
+	for (tt=0;tt<threads;++tt)
+		pthread_join(tid[tt], NULL);
+	pthread_barrier_destroy(&barrier);
+	//the roofs meet where the peak bandwidth times the intensity reaches the peak flops
+	printf ("Peak GFLOPS:\t%f\tPeak bandwidth (MB/s):\t%12.1f\tRidge point (flops/byte):\t%f\n", peak_flops, 1.0E-06*peak_bytes, peak_flops*1000000000/peak_bytes);
+	mem_free(a);
+	mem_free(c);
+	return 0;
+}
@@ -0,0 +1 @@
+./roofline $1
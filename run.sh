@@ -3,3 +3,5 @@
 sh bandwidth.sh $1 >> bandwidth.log
 sh latency.sh $1 >> latency.log
 sh fmadd.sh $1 >> fmadd.log
+sh roofline.sh $1 >> roofline.log
+sh gups.sh $1 >> gups.log
@@ -0,0 +1,206 @@
+/********************************************************************
+ * Shared timing module for fmadd.c, latency.c and bandwidth.c
+ * See timer.h for the description of the exported functions.
+ *******************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timer.h"
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+#define CALIBRATION_TIME 0.05					//seconds the TSC is compared against the clock
+#define OVERHEAD_SAMPLES 1000					//back-to-back timer calls to determine the overhead
+#define FREQ_ADDS (1L<<20)						//dependent adds of one round of the frequency loop
+#ifdef __MIC__
+#define CYCLES_PER_ADD 2						//a KNC thread cannot issue in back-to-back cycles
+#else
+#define CYCLES_PER_ADD 1
+#endif
+
+double bi_tsc_hz = 0;
+const char *bi_timer_name = "clock";
+double dTimerGranularity = 0;
+double dTimerOverhead = 0;
+
+static uint64_t tsc_base;						//TSC value at bi_timer_init()
+static double tsc_period;						//seconds per TSC tick
+static __thread double timer_start;				//per thread, the benchmarks time in every worker
+
+static double bi_getclock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9;
+}
+static double bi_gettsc()
+{
+	return (double) (bi_rdtsc() - tsc_base) * tsc_period;
+}
+double (*bi_gettime)() = bi_getclock;
+
+/* returns nonzero if CPUID reports an invariant TSC */
+static int tsc_invariant()
+{
+#ifdef __MIC__
+	return 1;							//KNC has a constant rate TSC but does not report it
+#else
+	uint32_t eax, ebx, ecx, edx;
+	__asm__ __volatile__ ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0x80000000));
+	if (eax < 0x80000007)
+		return 0;
+	__asm__ __volatile__ ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0x80000007));
+	return (edx >> 8) & 1;
+#endif
+}
+/* determines the TSC frequency by counting ticks over CALIBRATION_TIME seconds of the clock */
+static double tsc_calibrate()
+{
+	double t0, t1;
+	uint64_t c0, c1;
+
+	t0=bi_getclock();
+	c0=bi_rdtsc();
+	do
+	{
+		t1=bi_getclock();
+		c1=bi_rdtsc();
+	} while (t1-t0 < CALIBRATION_TIME);
+	return (double) (c1-c0)/(t1-t0);
+}
+
+void bi_timer_init(void)
+{
+	const char *env=getenv("BI_TIMER");
+	double t1, t2, min;
+	int i;
+
+	if ((env==NULL || strcmp(env, "clock")!=0) && tsc_invariant())
+	{
+		bi_tsc_hz=tsc_calibrate();
+		tsc_period=1.0/bi_tsc_hz;
+		tsc_base=bi_rdtsc();
+		bi_gettime=bi_gettsc;
+		bi_timer_name="tsc";
+	}
+	else
+	{
+		bi_tsc_hz=0;
+		bi_gettime=bi_getclock;
+		bi_timer_name="clock";
+	}
+
+	/* granularity: the smallest nonzero step between two readings */
+	min=1.0;
+	for (i=0;i<OVERHEAD_SAMPLES;++i)
+	{
+		t1=bi_gettime();
+		while ((t2=bi_gettime())==t1)
+			;
+		if (t2-t1<min)
+			min=t2-t1;
+	}
+	dTimerGranularity=min;
+
+	/* overhead: the cheapest back-to-back pair of readings */
+	min=1.0;
+	for (i=0;i<OVERHEAD_SAMPLES;++i)
+	{
+		t1=bi_gettime();
+		t2=bi_gettime();
+		if (t2-t1<min)
+			min=t2-t1;
+	}
+	dTimerOverhead=min;
+	IDL(1, printf("Timer: %s, %.3f MHz, granularity %e s, overhead %e s\n",
+		bi_timer_name, bi_tsc_hz*1.0e-6, dTimerGranularity, dTimerOverhead));
+}
+
+/* runs FREQ_ADDS dependent register adds, 16 per iteration so that the loop overhead hides
+ * behind them; adds of an immediate could be folded by the renamer of newer cores */
+static void add_chain()
+{
+	long n=FREQ_ADDS/16, x=0, y=1;
+	__asm__ __volatile__ (
+		"1:\n\t"
+		"add %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\t"
+		"add %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\t"
+		"add %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\t"
+		"add %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\tadd %2, %0\n\t"
+		"dec %1\n\t"
+		"jnz 1b"
+		: "+r" (x), "+r" (n) : "r" (y) : "cc");
+}
+/* the clock of the calling core in GHz from the fastest round of the add chain in CALIBRATION_TIME seconds */
+static double freq_calibrate()
+{
+	double start=bi_gettime(), t0, t, best=0;
+
+	add_chain();								//wakes the core up
+	do
+	{
+		t0=bi_gettime();
+		add_chain();
+		t=bi_gettime()-t0;
+		if (t>0 && (best==0 || t<best))
+			best=t;
+	} while (t0-start < CALIBRATION_TIME);
+	return best>0 ? (double) FREQ_ADDS*CYCLES_PER_ADD/best*1.0e-9 : 0;
+}
+
+float bi_cpu_freq()
+{
+	static float ghz=0;
+	const char *env;
+	char *unit;
+	double v;
+
+	if (ghz>0)
+		return ghz;
+	if ((env=getenv("BENCHIT_ARCH_SPEED"))!=NULL && (v=strtod(env, &unit))>0)
+	{
+		//e.g. 1.3G or 1300M, a plain number is MHz if it is large
+		if (*unit=='M' || *unit=='m' || (*unit=='\0' && v>100))
+			v*=1.0e-3;
+		ghz=v;
+	}
+	else if ((env=getenv("PHI_CPU_MHZ"))!=NULL && atof(env)>0)
+		ghz=atof(env)*1.0e-3;
+	else
+		ghz=freq_calibrate();
+	IDL(1, printf("Core clock: %.3f GHz\n", ghz));
+	return ghz;
+}
+
+double bi_startTimer()
+{
+	timer_start=bi_gettime();
+	return timer_start;
+}
+
+double bi_stopTimer()
+{
+	double diff=bi_gettime()-timer_start-dTimerOverhead;
+	if (diff<dTimerGranularity)
+		return INVALID_MEASUREMENT;
+	return diff;
+}
+
+double bi_getStartStopTime(double *startStop)
+{
+	double stop=bi_gettime();
+	double diff=stop-timer_start-dTimerOverhead;
+	startStop[0]=timer_start;
+	startStop[1]=stop;
+	if (diff<dTimerGranularity)
+		return INVALID_MEASUREMENT;
+	return diff;
+}
@@ -0,0 +1,66 @@
+/********************************************************************
+ * Shared timing module for fmadd.c, latency.c and bandwidth.c
+ *
+ * Implements the timer part of interface.h (bi_gettime, bi_startTimer,
+ * bi_stopTimer, bi_getStartStopTime, dTimerGranularity, dTimerOverhead)
+ * on top of a calibrated time stamp counter, falling back to
+ * clock_gettime(CLOCK_MONOTONIC_RAW) where the TSC is not usable.
+ *
+ * bi_cpu_freq() returns the core clock in GHz from BENCHIT_ARCH_SPEED
+ * (e.g. "1.3G" or "1300M") or PHI_CPU_MHZ if one of them is set, and
+ * otherwise measures it once with a chain of dependent integer adds,
+ * one cycle each (two on KNC, where a thread issues every other cycle),
+ * timed with bi_gettime() on the calling core.
+ *******************************************************************/
+
+#ifndef PHI_TIMER_H
+#define PHI_TIMER_H
+
+#include <stdint.h>
+#include "interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!@brief Frequency of the time stamp counter in Hz, 0 if bi_gettime() does
+ *        not use the TSC.
+ */
+extern double bi_tsc_hz;
+
+/*!@brief Name of the timer selected by bi_timer_init(), "tsc" or "clock". */
+extern const char *bi_timer_name;
+
+/*!@brief Selects and calibrates the timer. Has to be called once in main()
+ *        before any other timer function.
+ *
+ * The TSC is used if it is invariant (or the code is built for KNC, where it
+ * always is) and the environment variable BI_TIMER is not set to "clock".
+ * Measures dTimerGranularity and dTimerOverhead for the selected timer.
+ */
+void bi_timer_init(void);
+
+/*!@brief Reads the time stamp counter. */
+static inline uint64_t bi_rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+	return ((uint64_t) hi << 32) | lo;
+}
+
+/*!@brief Reads the time stamp counter once all earlier instructions, e.g. the
+ *        loads of a pointer chase, have completed.
+ */
+static inline uint64_t bi_rdtsc_ordered(void)
+{
+#ifndef __MIC__
+	__asm__ __volatile__ ("lfence" : : : "memory");		//KNC executes in order
+#endif
+	return bi_rdtsc();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif